@@ -0,0 +1,127 @@
+/*
+ * Clustering.h
+ *
+ * Splits the requests of a large fleet into groups that can be routed
+ * independently: by an angular sweep around the depot, or by k-means on
+ * their coordinates. Both are deterministic, so a run can be repeated.
+ */
+
+#ifndef SRC_CLUSTERING_H_
+#define SRC_CLUSTERING_H_
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+#define KMEANS_MAX_ITERATIONS 50
+
+/*
+ * Sorts the points by their angle around (cx, cy) and cuts the circle into
+ * k arcs with the same number of points (within one). The first arc starts
+ * after the widest empty angle, so a gap between groups is not split.
+ * Returns the arc of every point.
+ */
+inline vector<unsigned int> sweepClusters(const vector<pair<double, double>> &points, double cx, double cy, unsigned int k){
+	size_t n = points.size();
+	vector<unsigned int> cluster(n, 0);
+	if(n == 0 || k < 2)
+		return cluster;
+
+	vector<pair<double, size_t>> angle(n);
+	for(size_t i = 0; i < n; i++)
+		angle[i] = make_pair(atan2(points[i].second - cy, points[i].first - cx), i);
+	sort(angle.begin(), angle.end());
+
+	size_t first = 0;
+	double widest = -1;
+	for(size_t i = 0; i < n; i++){
+		double gap = (i == 0) ? angle[0].first + 2 * M_PI - angle[n - 1].first : angle[i].first - angle[i - 1].first;
+		if(gap > widest){
+			widest = gap;
+			first = i;
+		}
+	}
+	for(size_t j = 0; j < n; j++)
+		cluster[angle[(first + j) % n].second] = j * k / n;
+	return cluster;
+}
+
+/*
+ * Lloyd's k-means on points of any dimension, for at most maxIterations
+ * rounds or until no point changes cluster. The centres are seeded by
+ * farthest-first traversal from the point closest to the mean. Clusters
+ * may end up empty (duplicate points); the numbering is not compacted.
+ * Returns the cluster of every point.
+ */
+inline vector<unsigned int> kMeansClusters(const vector<vector<double>> &points, unsigned int k, unsigned int maxIterations = KMEANS_MAX_ITERATIONS){
+	size_t n = points.size();
+	vector<unsigned int> cluster(n, 0);
+	if(n == 0 || k < 2)
+		return cluster;
+	size_t dim = points[0].size();
+	k = min<size_t>(k, n);
+
+	auto distance = [&](const vector<double> &a, const vector<double> &b){
+		double s = 0;
+		for(size_t j = 0; j < dim; j++)
+			s += (a[j] - b[j]) * (a[j] - b[j]);
+		return s;
+	};
+
+	vector<double> mean(dim, 0);
+	for(const vector<double> &p : points)
+		for(size_t j = 0; j < dim; j++)
+			mean[j] += p[j] / n;
+	size_t seed = 0;
+	for(size_t i = 1; i < n; i++)
+		if(distance(points[i], mean) < distance(points[seed], mean))
+			seed = i;
+
+	vector<vector<double>> centre(1, points[seed]);
+	vector<double> nearest(n);
+	for(size_t i = 0; i < n; i++)
+		nearest[i] = distance(points[i], centre[0]);
+	while(centre.size() < k){
+		size_t far = max_element(nearest.begin(), nearest.end()) - nearest.begin();
+		centre.push_back(points[far]);
+		for(size_t i = 0; i < n; i++)
+			nearest[i] = min(nearest[i], distance(points[i], centre.back()));
+	}
+
+	for(unsigned int it = 0; it < maxIterations; it++){
+		bool changed = (it == 0);
+		for(size_t i = 0; i < n; i++){
+			unsigned int best = 0;
+			double bestDist = distance(points[i], centre[0]);
+			for(unsigned int c = 1; c < k; c++){
+				double dc = distance(points[i], centre[c]);
+				if(dc < bestDist){
+					bestDist = dc;
+					best = c;
+				}
+			}
+			if(best != cluster[i]){
+				cluster[i] = best;
+				changed = true;
+			}
+		}
+		if(!changed)
+			break;
+		vector<vector<double>> sum(k, vector<double>(dim, 0));
+		vector<size_t> count(k, 0);
+		for(size_t i = 0; i < n; i++){
+			count[cluster[i]]++;
+			for(size_t j = 0; j < dim; j++)
+				sum[cluster[i]][j] += points[i][j];
+		}
+		for(unsigned int c = 0; c < k; c++)
+			if(count[c] > 0)
+				for(size_t j = 0; j < dim; j++)
+					centre[c][j] = sum[c][j] / count[c];
+	}
+	return cluster;
+}
+
+#endif /* SRC_CLUSTERING_H_ */
@@ -0,0 +1,250 @@
+/*
+ * CompactGraph.h
+ * Read-only, compact representation of a map for large (multi-city) graphs.
+ * Vertices are addressed by 32-bit dense indices, edges are stored in
+ * compressed sparse row form (one offset array plus destination/weight
+ * arrays), weights are floats and coordinates are packed as 32-bit
+ * centimetres. There are no per-vertex or per-edge allocations.
+ */
+
+#ifndef SRC_COMPACTGRAPH_H_
+#define SRC_COMPACTGRAPH_H_
+
+#include <cstdint>
+
+#include "Graph.h"
+
+/*
+ * Memory used by a graph, in bytes. Figures for Graph<T> are estimates that
+ * count the node and bucket overhead of its hash tables.
+ */
+struct MemoryReport {
+  size_t vertices = 0, edges = 0;
+  size_t vertexBytes = 0, edgeBytes = 0;
+
+  double bytesPerVertex() const {
+    return vertices == 0 ? 0 : (double)vertexBytes / vertices;
+  }
+  double bytesPerEdge() const {
+    return edges == 0 ? 0 : (double)edgeBytes / edges;
+  }
+  size_t totalBytes() const { return vertexBytes + edgeBytes; }
+
+  void print(ostream &os, const string &name) const {
+    os << name << ": " << vertices << " vertices (" << bytesPerVertex()
+       << " B each), " << edges << " edges (" << bytesPerEdge()
+       << " B each), " << totalBytes() / 1024 << " KiB" << endl;
+  }
+};
+
+template <class T> class CompactGraph {
+  vector<T> info;                 // vertex contents, by index
+  vector<int32_t> x, y;           // centimetres
+  vector<uint32_t> byInfo;        // indices sorted by contents, for lookups
+  vector<uint32_t> firstEdge;     // edges of v: [firstEdge[v], firstEdge[v+1])
+  vector<uint32_t> edgeDest;
+  vector<float> edgeWeight;
+
+  void sortIndex();
+
+public:
+  CompactGraph();
+  CompactGraph(const Graph<T> &graph);
+  CompactGraph(vector<T> info, vector<int32_t> x, vector<int32_t> y,
+               const vector<pair<uint32_t, uint32_t>> &edges);
+
+  uint32_t getNumVertex() const;
+  uint32_t getNumEdges() const;
+  int findVertexIdx(const T &in) const;
+  T getInfo(uint32_t v) const;
+  double getX(uint32_t v) const;
+  double getY(uint32_t v) const;
+
+  uint32_t edgesBegin(uint32_t v) const;
+  uint32_t edgesEnd(uint32_t v) const;
+  uint32_t getEdgeDest(uint32_t e) const;
+  float getEdgeWeight(uint32_t e) const;
+
+  void dijkstraShortestPath(uint32_t source, vector<float> &dist,
+                            vector<int32_t> &path) const;
+
+  MemoryReport getMemoryReport() const;
+};
+
+template <class T> CompactGraph<T>::CompactGraph() : firstEdge(1, 0) {}
+
+/*
+ * Builds the compact form of an existing graph. Vertex indices are the same
+ * as in the original graph (Graph::findVertexIdx).
+ */
+template <class T> CompactGraph<T>::CompactGraph(const Graph<T> &graph) {
+  vector<Vertex<T> *> v = graph.getVertexSet();
+  info.reserve(v.size());
+  x.reserve(v.size());
+  y.reserve(v.size());
+  firstEdge.reserve(v.size() + 1);
+  firstEdge.push_back(0);
+  for (unsigned int i = 0; i < v.size(); i++) {
+    info.push_back(v[i]->getInfo());
+    x.push_back((int32_t)(v[i]->getX() * 100));
+    y.push_back((int32_t)(v[i]->getY() * 100));
+    vector<Edge<T>> e = v[i]->getEdges();
+    for (unsigned int a = 0; a < e.size(); a++) {
+      edgeDest.push_back(e[a].dest->getIndex());
+      edgeWeight.push_back((float)e[a].getWeight());
+    }
+    firstEdge.push_back(edgeDest.size());
+  }
+  edgeDest.shrink_to_fit();
+  edgeWeight.shrink_to_fit();
+  sortIndex();
+}
+
+/*
+ * Builds a graph straight from packed arrays (see readFromFilesCompact):
+ * edges are pairs of vertex indices and get the euclidean distance between
+ * their endpoints as weight. As in Graph<T>, whose vertices keep whole
+ * metres, the distance is taken between the truncated coordinates, so both
+ * graphs have the same weights.
+ */
+template <class T>
+CompactGraph<T>::CompactGraph(vector<T> info, vector<int32_t> x,
+                              vector<int32_t> y,
+                              const vector<pair<uint32_t, uint32_t>> &edges)
+    : info(std::move(info)), x(std::move(x)), y(std::move(y)) {
+  uint32_t n = this->info.size();
+  firstEdge.assign(n + 1, 0);
+  for (auto &e : edges)
+    firstEdge[e.first + 1]++;
+  for (uint32_t i = 1; i <= n; i++)
+    firstEdge[i] += firstEdge[i - 1];
+  vector<uint32_t> next(firstEdge.begin(), firstEdge.end() - 1);
+  edgeDest.resize(edges.size());
+  edgeWeight.resize(edges.size());
+  for (auto &e : edges) {
+    uint32_t pos = next[e.first]++;
+    edgeDest[pos] = e.second;
+    double dx = this->x[e.first] / 100 - this->x[e.second] / 100;
+    double dy = this->y[e.first] / 100 - this->y[e.second] / 100;
+    edgeWeight[pos] = (float)sqrt(dx * dx + dy * dy);
+  }
+  sortIndex();
+}
+
+template <class T> void CompactGraph<T>::sortIndex() {
+  byInfo.resize(info.size());
+  for (uint32_t i = 0; i < info.size(); i++)
+    byInfo[i] = i;
+  sort(byInfo.begin(), byInfo.end(),
+       [this](uint32_t a, uint32_t b) { return info[a] < info[b]; });
+}
+
+template <class T> uint32_t CompactGraph<T>::getNumVertex() const {
+  return info.size();
+}
+
+template <class T> uint32_t CompactGraph<T>::getNumEdges() const {
+  return edgeDest.size();
+}
+
+/*
+ * Binary search on the contents; returns -1 if there is no such vertex.
+ */
+template <class T> int CompactGraph<T>::findVertexIdx(const T &in) const {
+  auto it = lower_bound(byInfo.begin(), byInfo.end(), in,
+                        [this](uint32_t a, const T &b) { return info[a] < b; });
+  if (it == byInfo.end() || info[*it] != in)
+    return -1;
+  return *it;
+}
+
+template <class T> T CompactGraph<T>::getInfo(uint32_t v) const {
+  return info[v];
+}
+template <class T> double CompactGraph<T>::getX(uint32_t v) const {
+  return x[v] / 100.0;
+}
+template <class T> double CompactGraph<T>::getY(uint32_t v) const {
+  return y[v] / 100.0;
+}
+
+template <class T> uint32_t CompactGraph<T>::edgesBegin(uint32_t v) const {
+  return firstEdge[v];
+}
+template <class T> uint32_t CompactGraph<T>::edgesEnd(uint32_t v) const {
+  return firstEdge[v + 1];
+}
+template <class T> uint32_t CompactGraph<T>::getEdgeDest(uint32_t e) const {
+  return edgeDest[e];
+}
+template <class T> float CompactGraph<T>::getEdgeWeight(uint32_t e) const {
+  return edgeWeight[e];
+}
+
+/*
+ * Single source shortest paths into caller-provided arrays: dist[v] is the
+ * distance from source (infinity if unreachable) and path[v] the previous
+ * vertex index (-1 for the source and unreachable vertices).
+ */
+template <class T>
+void CompactGraph<T>::dijkstraShortestPath(uint32_t source, vector<float> &dist,
+                                           vector<int32_t> &path) const {
+  typedef pair<float, uint32_t> QueueEntry;
+  priority_queue<QueueEntry, vector<QueueEntry>, greater<QueueEntry>> q;
+  dist.assign(info.size(), numeric_limits<float>::infinity());
+  path.assign(info.size(), -1);
+  dist[source] = 0;
+  q.push(QueueEntry(0, source));
+  while (!q.empty()) {
+    QueueEntry top = q.top();
+    q.pop();
+    uint32_t v = top.second;
+    if (top.first > dist[v])
+      continue; // stale entry
+    for (uint32_t e = firstEdge[v]; e < firstEdge[v + 1]; e++) {
+      uint32_t w = edgeDest[e];
+      if (dist[v] + edgeWeight[e] < dist[w]) {
+        dist[w] = dist[v] + edgeWeight[e];
+        path[w] = v;
+        q.push(QueueEntry(dist[w], w));
+      }
+    }
+  }
+}
+
+template <class T> MemoryReport CompactGraph<T>::getMemoryReport() const {
+  MemoryReport r;
+  r.vertices = info.size();
+  r.edges = edgeDest.size();
+  r.vertexBytes = info.capacity() * sizeof(T) +
+                  (x.capacity() + y.capacity()) * sizeof(int32_t) +
+                  (byInfo.capacity() + firstEdge.capacity()) * sizeof(uint32_t);
+  r.edgeBytes = edgeDest.capacity() * sizeof(uint32_t) +
+                edgeWeight.capacity() * sizeof(float);
+  return r;
+}
+
+/*
+ * Estimated memory of the pointer-based Graph<T>: each vertex is a heap
+ * object plus a node and a bucket in the vertex hash table and a slot in the
+ * vertex set; each edge is a node and a bucket in its origin's edge table.
+ */
+template <class T> MemoryReport getMemoryReport(const Graph<T> &graph) {
+  const size_t hashNode = sizeof(void *) + sizeof(size_t); // next + hash code
+  MemoryReport r;
+  vector<Vertex<T> *> v = graph.getVertexSet();
+  r.vertices = v.size();
+  r.vertexBytes =
+      v.size() * (sizeof(Vertex<T>) + sizeof(Vertex<T> *) + hashNode +
+                  sizeof(void *) + sizeof(Vertex<T> *));
+  for (unsigned int i = 0; i < v.size(); i++) {
+    vector<Edge<T>> e = v[i]->getEdges();
+    r.edges += e.size();
+    for (unsigned int a = 0; a < e.size(); a++)
+      r.edgeBytes += sizeof(Edge<T>) + hashNode + sizeof(void *) +
+                     e[a].processedEdge.capacity() * sizeof(Vertex<T> *);
+  }
+  return r;
+}
+
+#endif /* SRC_COMPACTGRAPH_H_ */
@@ -11,29 +11,254 @@
 
 #include <vector>
 #include <algorithm>
+#include <sstream>
+#include <queue>
+#include <tuple>
+#include <thread>
+#include <map>
+#include <chrono>
 
 #include "Graph.h"
 #include "Vehicle.h"
 #include "Request.h"
+#include "DistanceMatrix.h"
+#include "FleetCost.h"
+#include "ThreadPool.h"
+#include "LocalSearch.h"
+#include "LargeNeighbourhoodSearch.h"
+#include "RouteSchedule.h"
+#include "ExactSolver.h"
+#include "PathTrees.h"
+#include "Clustering.h"
+#include "Snapshot.h"
 
 #define NUM_MAX_VEHICLES 10
+#define PARALLEL_MIN_WORK 20000	// below this many candidate insertions per request, vehicles are scored serially
+#define LS_MAX_MOVES 100000		// default local search budget, per specialty
+#define LS_MAX_MILLIS 0			// no time limit by default, so a run gives the same routes on any machine
+#define SNAPSHOT_MIN_MILLIS 20	// the local search publishes its routes at most this often
+
+/*
+ * Shortest path searches behind the distance matrices of a run. A node that
+ * several requests or vehicles use (or the origin) gets one slot and one
+ * search.
+ */
+struct MatrixStats{
+	unsigned long interestPoints = 0;	// pickups, deliveries and depots, repeats included, and the origin
+	unsigned long slots = 0;			// distinct nodes
+	unsigned long searches = 0;
+	unsigned long treeVertices = 0;		// kept in the path trees, over all roots
+	double millis = 0;
+
+	unsigned long savedSearches() const{
+		return interestPoints > searches ? interestPoints - searches : 0;
+	}
+
+	MatrixStats & operator+=(const MatrixStats &s){
+		interestPoints += s.interestPoints;
+		slots += s.slots;
+		searches += s.searches;
+		treeVertices += s.treeVertices;
+		millis += s.millis;
+		return *this;
+	}
+};
+
+/*
+ * Insertion candidates of a run, and how many of them a lower bound ruled out
+ * before their exact cost was worked out: whole vehicles, and pickup places
+ * whose scan of delivery places was skipped.
+ */
+struct InsertionStats{
+	unsigned long vehicles = 0, prunedVehicles = 0;
+	unsigned long pickups = 0, prunedPickups = 0;
+
+	InsertionStats & operator+=(const InsertionStats &s){
+		vehicles += s.vehicles;
+		prunedVehicles += s.prunedVehicles;
+		pickups += s.pickups;
+		prunedPickups += s.prunedPickups;
+		return *this;
+	}
+};
+
+/*
+ * Buffers the insertion heuristics reuse from one request and candidate to
+ * the next, one set per thread (see insertionScratch()): once they have grown
+ * to the largest route, scoring a request allocates nothing. Candidate routes
+ * are swapped in and out rather than copied, so route buffers circulate
+ * between the routes, the candidates and these.
+ */
+struct InsertionScratch{
+	vector<double> laterDelivery;				// getBestInsertion
+	vector<double> mergedCost;
+	vector<vector<unsigned int>> mergedPath;
+	vector<unsigned int> route;					// a candidate only its score is kept of
+	vector<double> bound, dist;					// per vehicle
+	vector<unsigned int> order, rest;
+	vector<InsertionStats> counts;
+};
+
+inline InsertionScratch & insertionScratch(){
+	static thread_local InsertionScratch scratch;
+	return scratch;
+}
+
+/*
+ * Vehicles of a run grouped by their depots, and the group each request was
+ * pre-assigned to: the one whose depots are closest to it. Only that group's
+ * vehicles are scored for the request, unless none of them can take it.
+ */
+struct DepotGroups{
+	vector<int> group;		// per vehicle
+	vector<int> home;		// per request, -1: any vehicle
+
+	bool allows(unsigned int r, unsigned int b) const{
+		return home[r] == -1 || home[r] == group[b];
+	}
+	void candidates(unsigned int r, vector<bool> &allowed) const{
+		allowed.clear();
+		if(home[r] != -1)
+			for(size_t b = 0; b < group.size(); b++)
+				allowed.push_back(group[b] == home[r]);
+	}
+};
+
+/*
+ * The cluster-first phase of a run: how many groups of requests and vehicles
+ * were solved on their own, the requests of the largest one, how many
+ * requests no vehicle of their group could take and went to another group's
+ * vehicle afterwards, and how long the groups took to cluster and solve.
+ */
+struct ClusterStats{
+	unsigned int clusters = 0;
+	unsigned long largest = 0;
+	unsigned long outside = 0;
+	double millis = 0;
+
+	ClusterStats & operator+=(const ClusterStats &s){
+		clusters += s.clusters;
+		largest = std::max(largest, s.largest);
+		outside += s.outside;
+		millis += s.millis;
+		return *this;
+	}
+};
+
+/*
+ * Counters of the phases of a run, summed over specialties.
+ */
+struct SolverStats{
+	MatrixStats matrix;
+	InsertionStats insertion;
+	LocalSearchStats localSearch;
+	LNSStats lns;
+	ClusterStats clusters;
+
+	SolverStats & operator+=(const SolverStats &s){
+		matrix += s.matrix;
+		insertion += s.insertion;
+		localSearch += s.localSearch;
+		lns += s.lns;
+		clusters += s.clusters;
+		return *this;
+	}
+};
+
+/*
+ * What happened to one request added while online: whether it got into a
+ * route (and which vehicle of its specialty), how much longer that route
+ * got, and how long each step took.
+ */
+struct DispatchReport{
+	bool served = false;
+	int vehicle = -1;			// among the vehicles of the specialty
+	unsigned int newSlots = 0;	// interest points added to the matrix
+	double addedCost = 0;
+	InsertionStats insertion;
+	LocalSearchStats repair;
+	double matrixMillis = 0;
+	double insertMillis = 0;
+	double millis = 0;			// in total
+};
+
+template <class T>
+class SolverHandle;
 
 template <class T>
 class DeliverySystem{
 
+	friend class SolverHandle<T>;
+
 	Graph<T> originalMap;
 	Graph<T> processedMap;	
+	DistanceMatrix<T> distances;	// interest point distances, slot 0 is origNode
+	PathTrees<T> trees;				// of every interest point searched from, to expand routes
 
 	vector<Vehicle<T>> vehicles;
 	vector<Request<T>> requests;
 	T origNode = 0;
-
-	double (DeliverySystem<T>::*calculateVehiclesPtr) (string str) = &DeliverySystem<T>::calculateVehiclesWeight_vehicles;
-
-	double calculatePathWeight(vector<T> path);
-	double calculateVehiclesWeight_vehicles(string str = "");
-	double calculateVehiclesWeight_time(string str = "");
-	double getMin(vector<T> &temp , size_t pos , T value, size_t r);
+	unsigned int numThreads = 0;	// 0: one per core
+	unsigned int lsMaxMoves = LS_MAX_MOVES;
+	double lsMaxMillis = LS_MAX_MILLIS;
+	unsigned long lnsMaxIterations = 0;	// ruin and recreate is off by default
+	double lnsMaxMillis = 0;
+	unsigned int lnsSeed = 0;
+	unsigned int regretK = 0;	// < 2: requests are inserted in input order
+	bool nearestDepot = false;	// requests go to the vehicles of their closest depots
+	unsigned int clusterCount = 0;	// < 2: no cluster-first phase
+	bool clusterByKMeans = false;	// else by sweep
+	SolverStats stats;
+	ExactStats exactStats;
+
+	bool online = false;
+	unsigned int repairMaxMoves = 0;
+	double repairMaxMillis = 0;
+	map<string, DistanceMatrix<T>> onlineDistances;	// per specialty, kept from the last run
+	vector<DispatchReport> dispatches;
+
+	const atomic<bool> *stopFlag = nullptr;	// set while a SolverHandle runs: ends the improvement phases
+	SnapshotBoard<T> *board = nullptr;		// and where it reads the best routes so far
+
+	double (DeliverySystem<T>::*calculateVehiclesPtr) (const FleetCost &fleet, size_t b, double cost, bool exact) const = &DeliverySystem<T>::calculateVehiclesWeight_vehicles;
+
+	double calculatePathWeight(const DistanceMatrix<T> &d, const vector<unsigned int> &route, const RouteEnds &ends = RouteEnds()) const;
+	double calculateRouteCost(const DistanceMatrix<T> &d, const vector<unsigned int> &route, const RouteEnds &ends, const RouteProfile &profile) const;
+	double calculateVehiclesWeight_vehicles(const FleetCost &fleet, size_t b, double cost, bool exact = false) const;
+	double calculateVehiclesWeight_time(const FleetCost &fleet, size_t b, double cost, bool exact = false) const;
+	double getMin(const DistanceMatrix<T> &d, const RouteEnds &ends, vector<unsigned int> &v, size_t pos, size_t stop) const;
+	double getBestInsertion(const DistanceMatrix<T> &d, const RouteEnds &ends, const RouteIndex &index, const vector<unsigned int> &path, unsigned int pickup, unsigned int delivery, vector<unsigned int> &next, InsertionStats *stats = nullptr) const;
+	double getBestInsertion(const DistanceMatrix<T> &d, const FleetSchedule<T> &schedule, unsigned int b, const vector<unsigned int> &path, unsigned int pickup, unsigned int delivery, size_t r, vector<unsigned int> &next, InsertionStats *stats = nullptr) const;
+	static void insertRequest(const vector<unsigned int> &path, unsigned int pickup, unsigned int delivery, size_t a, size_t i, vector<unsigned int> &next);
+	double getInsertionLowerBound(const DistanceMatrix<T> &d, const RouteEnds &ends, const vector<unsigned int> &path, unsigned int pickup, unsigned int delivery) const;
+	void scoreVehicles(const DistanceMatrix<T> &d, const vector<vector<unsigned int>> &routes, const FleetCost &fleet, const FleetSchedule<T> &schedule, const vector<bool> &allowed, unsigned int pickup, unsigned int delivery, size_t r,
+			vector<double> &cost, vector<double> &v_dist, vector<vector<unsigned int>> &candidate, ThreadPool &pool, InsertionStats &stats) const;
+	static RequestConstraint getConstraint(const Request<T> &request);
+	unsigned int selectVehicle(const FleetCost &fleet, const vector<double> &cost, const vector<double> &v_dist) const;
+	InsertionStats insertInOrder(const DistanceMatrix<T> &d, vector<vector<unsigned int>> &routes, FleetCost &fleet, const vector<pair<unsigned int, unsigned int>> &slots, vector<int> &owner, FleetSchedule<T> &schedule, const DepotGroups &depots, ThreadPool &pool) const;
+	InsertionStats insertByRegret(const DistanceMatrix<T> &d, vector<vector<unsigned int>> &routes, FleetCost &fleet, const vector<pair<unsigned int, unsigned int>> &slots, vector<int> &owner, FleetSchedule<T> &schedule, const DepotGroups &depots, ThreadPool &pool) const;
+
+	T getStartNode(const Vehicle<T> &vehicle) const;
+	T getEndNode(const Vehicle<T> &vehicle) const;
+	vector<T> getDepots(string str) const;
+	vector<RouteEnds> getRouteEnds(const DistanceMatrix<T> &d, const vector<Vehicle<T> *> &v) const;
+	static vector<RouteProfile> getRouteProfiles(const vector<Vehicle<T> *> &v);
+	static bool isServable(const DistanceMatrix<T> &d, const vector<RouteEnds> &ends, unsigned int pickup, unsigned int delivery);
+	DepotGroups assignDepots(const DistanceMatrix<T> &d, const vector<RouteEnds> &ends, const vector<pair<unsigned int, unsigned int>> &slots) const;
+	bool clusterRequests(const vector<Vehicle<T> *> &v, const vector<Request<T>> &r, vector<vector<unsigned int>> &vehiclesOf, vector<vector<unsigned int>> &requestsOf) const;
+	SolverStats solveRoutes(const DistanceMatrix<T> &matrix, vector<vector<unsigned int>> &routes, FleetCost &fleet, const vector<pair<unsigned int, unsigned int>> &slots, vector<int> &owner,
+			const vector<RequestConstraint> &constraints, const vector<double> &capacity, const vector<RouteEnds> &ends, const vector<RouteProfile> &profiles, const vector<unsigned int> &index,
+			ThreadPool &pool, double workShare = 1, double timeShare = 1) const;
+	void publish(const DistanceMatrix<T> &matrix, const vector<unsigned int> &index, const vector<vector<unsigned int>> &routes, const vector<RouteEnds> &ends, const vector<RouteProfile> &profiles) const;
+
+	MatrixStats setProcessedMap(string str, Graph<T> &processed, DistanceMatrix<T> &matrix, PathTrees<T> &trees);
+	SolverStats newAlgorithm2(string str, const DistanceMatrix<T> &matrix, unsigned int threads);
+	void solveEspecialidades();
+	ExactStats solveExact(string str, const DistanceMatrix<T> &matrix, double maxMillis);
+	string getInvalidReport(string str);
+
+	void extendDistances(DistanceMatrix<T> &matrix, const vector<T> &nodes);
+	DispatchReport dispatch(size_t i);
 
 
 public:
@@ -48,6 +273,7 @@ public:
 
 	Graph<T> * getMap();
 	Graph<T> * getProcessedMap();
+	const DistanceMatrix<T> & getDistanceMatrix() const;
 
 	void initiateRoutes(T data);
 	void initiateRoutes();
@@ -68,6 +294,8 @@ public:
 	vector<Vehicle<T> *> getVehicles(string str = "");
 
 	vector<vector<T>> getVehiclesPath() const;
+	void expandPath(const vector<T> &path, vector<T> &out);
+	void expandPath(const vector<T> &path, vector<T> &out, T start, T end);
 	vector<vector<T>> getVehiclesCompletePath();
 	vector<Path<T>> getVehiclesCompletePaths();
 
@@ -79,12 +307,29 @@ public:
 
 	void run(string str = "");
 	void runEspecialidades();
+	void runExact(double maxMillis = 0);
 
 	void addVehicle(Vehicle<T> vehicle);
 	void addVehicle(string esp);
 
 	void setRunByVehicles();
 	void setRunByTime();
+	void setInsertionByOrder();
+	void setInsertionByRegret(unsigned int k = 2);
+	void setNearestDepot(bool on);
+	void setClustersBySweep(unsigned int k);
+	void setClustersByKMeans(unsigned int k);
+	void setNumThreads(unsigned int n);
+	void setLocalSearch(unsigned int maxMoves, double maxMillis);
+	void setLNS(unsigned long maxIterations, double maxMillis, unsigned int seed = 0);
+	MatrixStats getMatrixStats() const;
+	InsertionStats getInsertionStats() const;
+	LocalSearchStats getLocalSearchStats() const;
+	LNSStats getLNSStats() const;
+	ClusterStats getClusterStats() const;
+	ExactStats getExactStats() const;
+	void setOnline(bool on, unsigned int repairMoves = 0, double repairMillis = 0);
+	vector<DispatchReport> getDispatchReports() const;
 
 	vector<Request<T>> getInvalidRequest(string str = "") ;
 	vector<Request<T>> getValidRequest(string str = "")const ;
@@ -123,13 +368,33 @@ void DeliverySystem<T>::setOriginNode(T data){
 template<class T>
 void DeliverySystem<T>::setOriginalGraph(Graph<T> g){
 	originalMap = g;
+	trees.clear();
 }
 
 template<class T>
 void DeliverySystem<T>::setProcessedMap(string str) {
+	setProcessedMap(str, processedMap, distances, trees);
+	cout<<endl;
+}
+
+/*
+ * Builds the processed map and distance matrix of a specialty ("" for all
+ * requests) into the given objects. originalMap is only read and only the
+ * requests of the specialty are written (their valid flag), so specialties
+ * can be processed concurrently. The depots of the specialty's vehicles get
+ * slots after the origin, like interest points: each distinct node gets one
+ * slot and one search, however many requests or vehicles use it, whose legs
+ * to the other slots go to trees. A request no vehicle can serve, from its
+ * depots and back, is marked invalid.
+ */
+template<class T>
+MatrixStats DeliverySystem<T>::setProcessedMap(string str, Graph<T> &processed, DistanceMatrix<T> &matrix, PathTrees<T> &trees) {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	MatrixStats report;
 
 	for(size_t i = 0; i < requests.size();i++){
-		requests[i].setValid(true);
+		if(str == "" || requests[i].getEspecialidade() == str)
+			requests[i].setValid(true);
 	}
 
 	/*vector<Request<T>> v = getValidRequest();
@@ -139,58 +404,70 @@ void DeliverySystem<T>::setProcessedMap(string str) {
 
 	Graph<T> tempGraph;
 	vector<T> intPoints = (str == "") ? getInterestPoints() : getInterestPoints(str);
-
-	vector<Vertex<T>*> path;
-
-	originalMap.dijkstraShortestPath(origNode);
-	for(unsigned int j=0; j<intPoints.size(); j++) {
-		path = originalMap.getPathV(origNode,intPoints.at(j));
-		if(path.size() == 0){
-			for(size_t a = 0; a < requests.size();a++){
-				if(requests[a].getInicio() == intPoints[j] || requests[a].getFim() == intPoints[j]){
-					requests[a].setValid(false);
-				}
-			}
-			continue;
-		}
-		tempGraph.addProcessedEdge(origNode, intPoints.at(j), path);
-	}
-
-	/*v = getValidRequest();
-	for(size_t i = 0; i < v.size();i++)
-		cout<<"Valid request from "<<v[i].getInicio()<<" to "<<v[i].getFim()<<".\n";*/
-
-	cout<<endl;
-
-	intPoints.push_back(origNode);
-
+	vector<T> depots = getDepots(str);
+
+	matrix.clear();
+	matrix.addSlot(origNode);
+	for(unsigned int j=0; j<depots.size(); j++)
+		matrix.addSlot(depots[j]);
+	for(unsigned int j=0; j<intPoints.size(); j++)
+		matrix.addSlot(intPoints[j]);
+	matrix.allocate();
+
+	//searches go to local arrays, so the vertices of originalMap are untouched
+	vector<double> dist;
+	vector<int> nearest, pred;
+	auto search = [&](T node){
+		int idx = originalMap.findVertexIdx(node);
+		if(idx == -1)
+			dist.clear();
+		else
+			originalMap.dijkstraShortestPath(vector<unsigned int>(1, idx), dist, nearest, pred);
+	};
 	for(unsigned int i=0;i<intPoints.size(); i++) {
 		tempGraph.addVertex(intPoints.at(i));
 	}
-
-	for(unsigned int i=1; i<=intPoints.size(); i++) {
-		originalMap.dijkstraShortestPath(intPoints.at(i-1));
-		for(unsigned int j=0; j<intPoints.size(); j++) {
-			path = originalMap.getPathV(intPoints.at(i-1),intPoints.at(j));
-			if(path.size() == 0){
-				if(intPoints[j] == origNode){
-					for(size_t a = 0; a < requests.size();a++){
-						if(requests[a].getInicio() == intPoints[i-1] || requests[a].getFim() == intPoints[i-1]){
-							requests[a].setValid(false);
-						}
-					}
-				}
+	tempGraph.addVertex(origNode);
+	for(unsigned int i=0;i<depots.size(); i++)
+		tempGraph.addVertex(depots[i]);
+
+	//one search per slot; the legs between slots are kept in trees, the
+	//processed map only gets their lengths
+	unsigned int n = matrix.size();
+	vector<int> idx(n);
+	for(unsigned int j = 0; j < n; j++)
+		idx[j] = originalMap.findVertexIdx(matrix.getNode(j));
+	for(unsigned int i = 0; i < n; i++) {
+		T node = matrix.getNode(i);
+		search(node);
+		if(idx[i] == -1)
+			continue;
+		for(unsigned int j = 0; j < n; j++) {
+			if(idx[j] == -1 || dist[idx[j]] == INF)
 				continue;
-			}
-			tempGraph.addProcessedEdge(intPoints.at(i-1), intPoints.at(j), path);
+			tempGraph.addEdge(node, matrix.getNode(j), dist[idx[j]]);
+			matrix.set(i, j, dist[idx[j]]);
 		}
+		trees.set(originalMap, node, pred, idx);
 	}
+	report.interestPoints = intPoints.size() + depots.size() + 1;
+	report.slots = n;
+	report.searches = n;
+	report.treeVertices = trees.size();
+
+	vector<RouteEnds> ends = getRouteEnds(matrix, getVehicles(str));
+	for(size_t a = 0; a < requests.size();a++)
+		if(str == "" || requests[a].getEspecialidade() == str)
+			if(!isServable(matrix, ends, matrix.getSlot(requests[a].getInicio()), matrix.getSlot(requests[a].getFim())))
+				requests[a].setValid(false);
 
 	/*v = getValidRequest();
 	for(size_t i = 0; i < v.size();i++)
 		cout<<"Valid request from "<<v[i].getInicio()<<" to "<<v[i].getFim()<<".\n";*/
 
-	processedMap = tempGraph;
+	processed = tempGraph;
+	report.millis = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	return report;
 }
 
 template<class T>
@@ -199,173 +476,1041 @@ Graph<T> * DeliverySystem<T>::getMap(){return &originalMap;}
 template<class T>
 Graph<T> * DeliverySystem<T>::getProcessedMap(){return &processedMap;}
 
+template<class T>
+const DistanceMatrix<T> & DeliverySystem<T>::getDistanceMatrix() const{return distances;}
+
 template<class T>
 void DeliverySystem<T>::initiateRoutes(T data){
 	originalMap.dijkstraShortestPath(data);
 }
 
+/*
+ * Length of a route given as matrix slots, leaving from and returning to the
+ * given ends (origNode, slot 0, by default). An empty route still drives
+ * from its start depot to its end one.
+ */
 template<class T>
-double DeliverySystem<T>::calculatePathWeight(vector<T> path){
+double DeliverySystem<T>::calculatePathWeight(const DistanceMatrix<T> &d, const vector<unsigned int> &route, const RouteEnds &ends) const{
 	double dist = 0;
-	if(path.size() == 0)
-		return dist;
-	dist+=processedMap.getWeight(origNode , path[0]);
-	for(unsigned int i = 0; i < path.size()-1 ; i++){
-		dist+=processedMap.getWeight(path[i] , path[i+1]);
+	if(route.size() == 0)
+		return d.get(ends.start, ends.end);
+	dist+=d.get(ends.start , route[0]);
+	for(unsigned int i = 0; i < route.size()-1 ; i++){
+		dist+=d.get(route[i] , route[i+1]);
 	}
-	dist+=processedMap.getWeight(path[path.size()-1] , origNode);
+	dist+=d.get(route[route.size()-1] , ends.end);
 	return dist;
 }
 
+/*
+ * Cost of a route to a vehicle of the given profile: its fixed cost if the
+ * route has stops, plus its cost per distance times the length.
+ */
 template<class T>
-double DeliverySystem<T>::calculateVehiclesWeight_vehicles(string str){
-	double dist = 0;
-	vector<Vehicle<T>* >currentVehicles = getVehicles(str);
-	for(unsigned int i = 0; i < currentVehicles.size();i++){
-		double temp = calculatePathWeight(currentVehicles[i]->getPath());
-		dist+=temp;
-	}
-	return dist;
+double DeliverySystem<T>::calculateRouteCost(const DistanceMatrix<T> &d, const vector<unsigned int> &route, const RouteEnds &ends, const RouteProfile &profile) const{
+	return profile.cost(calculatePathWeight(d, route, ends), !route.empty());
 }
 
+/*
+ * Fleet objectives with the route of vehicle b costing cost and every other
+ * route as cached in fleet. Only vehicle b is looked at, unless exact is set,
+ * in which case the total is summed again in vehicle order.
+ */
 template<class T>
-double DeliverySystem<T>::calculateVehiclesWeight_time(string str){
-	double dist = 0;
-	double max = 0;
-	vector<Vehicle<T>* >currentVehicles = getVehicles(str);
-	for(unsigned int i = 0; i < currentVehicles.size();i++){
-		double temp = calculatePathWeight(currentVehicles[i]->getPath());
-		if(temp > max){
-			max = temp;
-		}
-		dist+=temp;
-	}
-	return dist + max;
+double DeliverySystem<T>::calculateVehiclesWeight_vehicles(const FleetCost &fleet, size_t b, double cost, bool exact) const{
+	if(exact)
+		return fleet.getTotal(b, cost);
+	return fleet.getTotal() - fleet.getCost(b) + cost;
 }
 
 template<class T>
-double DeliverySystem<T>::getMin(vector<T> &v , size_t pos , T value, size_t r){
-	//int ttt = pos;
-	/*for(size_t i = 0; i < v.size();i++)
-		cout<<v[i]<<"  ";
-	cout<<"\n value = "<<value<<endl;*/
-	//int iter = 0;
-	double min = INF;
-	double dist = 0;
-	vector<T> t;
-	//cout<<endl;
-	for(size_t i = pos+1; i < v.size();i++){
-		if(v[i] == value){
-			v.erase(v.begin() + i);
-			for(size_t a = 0 ; a < requests.size() && a < r;a++){
-				if(requests[a].getFim() == value ){
-					for(size_t b = i; b < v.size();b++){
-						if(v[b] == requests[a].getInicio() ){
-							pos = b;
-						}
-					}
-				}
+double DeliverySystem<T>::calculateVehiclesWeight_time(const FleetCost &fleet, size_t b, double cost, bool exact) const{
+	double max = std::max(fleet.getMaxExcluding(b), cost);
+	if(exact)
+		return fleet.getTotal(b, cost) + max;
+	return fleet.getTotal() - fleet.getCost(b) + cost + max;
+}
+
+/*
+ * Moves stop (after pos) of v to the cheapest place after pos, in place.
+ * Returns the new length; every place is scored in full, in the order
+ * calculatePathWeight sums, without building the candidate route.
+ */
+template<class T>
+double DeliverySystem<T>::getMin(const DistanceMatrix<T> &d, const RouteEnds &ends, vector<unsigned int> &v, size_t pos, size_t stop) const{
+	unsigned int value = v[stop];
+	v.erase(v.begin() + stop);
+	//length of v with value before v[i] (v.size(): at the end)
+	auto lengthWith = [&](size_t i){
+		double dist = 0;
+		unsigned int prev = ends.start;
+		for(size_t k = 0; k <= v.size(); k++){
+			if(k == i){
+				dist += d.get(prev, value);
+				prev = value;
+			}
+			if(k < v.size()){
+				dist += d.get(prev, v[k]);
+				prev = v[k];
 			}
 		}
-	}
+		return dist + d.get(prev, ends.end);
+	};
+	double min = INF;
+	size_t best = v.size() + 1;
 	for(size_t i = pos+1; i < v.size();i++){
-		vector<T> temp = v;
-		temp.insert(temp.begin() + i,value);
-		dist = calculatePathWeight(temp);
+		double dist = lengthWith(i);
 		if(dist < min){
 			min = dist;
-			t = temp;
+			best = i;
 		}
-		//iter++;
 	}
-	vector<T> temp = v;
-	temp.push_back(value);
-	dist = calculatePathWeight(temp);
+	double dist = lengthWith(v.size());
 	if(dist < min){
 		min = dist;
-		t = temp;
+		best = v.size();
 	}
-	v = t;
-	/*for(size_t i = pos+1; i < v.size();i++){
-		cout<<v[i]<<" -> ";
+	if(best <= v.size())
+		v.insert(v.begin() + best, value);
+	return min;
+}
+
+
+/*
+ * Cheapest insertion of a request (pickup before delivery) into a route
+ * between the given depots.
+ * Every pair of positions is scored in O(1) from the distance matrix as
+ * d(prev,x) + d(x,next) - d(prev,next) on top of the current route length,
+ * so a route of length L costs O(L^2) and no candidate route is built.
+ * When the delivery node is already in the route after the pickup, the
+ * request is delivered at that stop instead, which getMin may then move
+ * anywhere after the pickups of the requests delivered there (see
+ * RouteIndex), unless it is a pickup too.
+ * Incremental scores may differ from a full recomputation in the last bits,
+ * which would break exact ties differently, so the few candidates within
+ * rounding distance of the best are rescored in full and the first minimum,
+ * in the original order (pickup, then delivery, then appending both), wins.
+ * A delivery after a later stop adds the same whatever the pickup place, so
+ * the cheapest of those (a suffix minimum) bounds every such candidate, and
+ * a pickup place whose bound is above the best so far is not scanned.
+ * Returns the new route length and the route in next. The working buffers
+ * come from the thread's InsertionScratch.
+ */
+template<class T>
+double DeliverySystem<T>::getBestInsertion(const DistanceMatrix<T> &d, const RouteEnds &ends, const RouteIndex &index, const vector<unsigned int> &path, unsigned int pickup, unsigned int delivery, vector<unsigned int> &next, InsertionStats *stats) const{
+	InsertionScratch &scratch = insertionScratch();
+	size_t L = path.size();
+	double base = calculatePathWeight(d, path, ends);
+
+	int lastDelivery = -1;
+	for(size_t k = 0; k < L; k++)
+		if(path[k] == delivery)
+			lastDelivery = k;
+
+	//route length with the pickup before path[a] and the delivery before
+	//path[i] (index L stands for the return to the end depot)
+	auto costP = [&](size_t a){
+		unsigned int prev = (a == 0) ? ends.start : path[a-1];
+		unsigned int to = (a == L) ? ends.end : path[a];
+		return base + d.get(prev, pickup) + d.get(pickup, to) - d.get(prev, to);
+	};
+	auto costPQ = [&](size_t a, double cp, size_t i){
+		if(i == a){
+			unsigned int to = (a == L) ? ends.end : path[a];
+			return cp + d.get(pickup, delivery) + d.get(delivery, to) - d.get(pickup, to);
+		}
+		unsigned int from = path[i-1];
+		unsigned int to = (i == L) ? ends.end : path[i];
+		return cp + d.get(from, delivery) + d.get(delivery, to) - d.get(from, to);
+	};
+	auto fullCost = [&](size_t a, size_t i){
+		double dist = 0;
+		unsigned int prev = ends.start;
+		for(size_t k = 0; k <= L; k++){
+			if(k == a){
+				dist += d.get(prev, pickup);
+				prev = pickup;
+			}
+			if(k == i){
+				dist += d.get(prev, delivery);
+				prev = delivery;
+			}
+			unsigned int to = (k == L) ? ends.end : path[k];
+			dist += d.get(prev, to);
+			prev = to;
+		}
+		return dist;
+	};
+
+	//cheapest delivery before path[j] for some j >= i, pickup earlier
+	vector<double> &laterDelivery = scratch.laterDelivery;
+	laterDelivery.assign(L + 2, INF);
+	for(size_t i = L; i >= 1; i--){
+		unsigned int to = (i == L) ? ends.end : path[i];
+		double cd = d.get(path[i-1], delivery) + d.get(delivery, to) - d.get(path[i-1], to);
+		laterDelivery[i] = std::min(laterDelivery[i + 1], cd);
 	}
-	cout<<endl;*/
-	//cout<<"\n\nNUM_ITER : " << iter<<"\n\n"<<endl;
+	//the bound is summed in another order than costPQ, so it may be off by rounding
+	auto beyond = [](double bound, double limit){
+		return bound > limit + limit * 1e-9 + 1e-9;
+	};
+
+	//merged candidates come from getMin, which already returns full lengths
+	vector<double> &mergedCost = scratch.mergedCost;
+	vector<vector<unsigned int>> &mergedPath = scratch.mergedPath;
+	mergedCost.assign(lastDelivery + 1, INF);
+	if(mergedPath.size() < mergedCost.size())
+		mergedPath.resize(mergedCost.size());
+
+	double best = INF;
+	InsertionStats counts;
+	for(size_t a = 0; a < L; a++){
+		double cp = costP(a);
+		if(cp > best)
+			continue;
+		if((int)a <= lastDelivery){
+			mergedPath[a].assign(path.begin(), path.begin() + a);
+			mergedPath[a].push_back(pickup);
+			mergedPath[a].insert(mergedPath[a].end(), path.begin() + a, path.end());
+			//stops from a on moved one place back for the pickup
+			size_t stop = lastDelivery + 1;
+			if(index.pickup[lastDelivery])
+				mergedCost[a] = calculatePathWeight(d, mergedPath[a], ends);
+			else{
+				int latest = index.latestPickup[lastDelivery];
+				size_t after = (latest >= (int)a) ? latest + 1 : a;
+				mergedCost[a] = getMin(d, ends, mergedPath[a], after, stop);
+			}
+			best = std::min(best, mergedCost[a]);
+			continue;
+		}
+		best = std::min(best, costPQ(a, cp, a));
+		counts.pickups++;
+		if(beyond(cp + laterDelivery[a + 1], best)){
+			counts.prunedPickups++;
+			continue;
+		}
+		for(size_t i = a + 1; i <= L; i++)
+			best = std::min(best, costPQ(a, cp, i));
+	}
+	if(stats)
+		*stats += counts;
+	best = std::min(best, costPQ(L, costP(L), L));
+
+	//rescore the candidates that may tie with the best one
+	double tolerance = best * 1e-9 + 1e-9;
+	double min = INF;
+	size_t bestA = 0, bestI = 0;
+	int merged = -1;
+	for(size_t a = 0; a < L; a++){
+		if((int)a <= lastDelivery){
+			if(mergedCost[a] <= best + tolerance && mergedCost[a] < min){
+				min = mergedCost[a];
+				merged = a;
+			}
+			continue;
+		}
+		double cp = costP(a);
+		if(cp > best + tolerance)
+			continue;
+		size_t last = beyond(cp + laterDelivery[a + 1], best + tolerance) ? a : L;
+		for(size_t i = a; i <= last; i++){
+			if(costPQ(a, cp, i) > best + tolerance)
+				continue;
+			double dist = fullCost(a, i);
+			if(dist < min){
+				min = dist;
+				bestA = a;
+				bestI = i;
+				merged = -1;
+			}
+		}
+	}
+	if(costPQ(L, costP(L), L) <= best + tolerance){
+		double dist = fullCost(L, L);
+		if(dist < min){
+			min = dist;
+			bestA = bestI = L;
+			merged = -1;
+		}
+	}
+
+	if(merged != -1){
+		next.swap(mergedPath[merged]);
+		return min;
+	}
+	insertRequest(path, pickup, delivery, bestA, bestI, next);
 	return min;
 }
 
+/*
+ * As above, but when some request or vehicle is constrained the request goes
+ * to the cheapest place the schedule of route b allows; INF if there is none.
+ */
+template<class T>
+double DeliverySystem<T>::getBestInsertion(const DistanceMatrix<T> &d, const FleetSchedule<T> &schedule, unsigned int b, const vector<unsigned int> &path, unsigned int pickup, unsigned int delivery, size_t r, vector<unsigned int> &next, InsertionStats *stats) const{
+	if(!schedule.active())
+		return getBestInsertion(d, schedule.getEnds(b), schedule.getIndex(b), path, pickup, delivery, next, stats);
+	size_t a = 0, i = 0;
+	if(schedule.cheapestInsertion(b, path, r, a, i) >= INF)
+		return INF;
+	insertRequest(path, pickup, delivery, a, i, next);
+	return calculatePathWeight(d, next, schedule.getEnds(b));
+}
+
+/*
+ * next becomes path with the pickup before stop a and the delivery before
+ * stop i (path.size(): at the end), a <= i, reusing next's buffer.
+ */
+template<class T>
+void DeliverySystem<T>::insertRequest(const vector<unsigned int> &path, unsigned int pickup, unsigned int delivery, size_t a, size_t i, vector<unsigned int> &next){
+	size_t L = path.size();
+	next.clear();
+	next.reserve(L + 2);
+	for(size_t k = 0; k <= L; k++){
+		if(k == a)
+			next.push_back(pickup);
+		if(k == i)
+			next.push_back(delivery);
+		if(k < L)
+			next.push_back(path[k]);
+	}
+}
+
+/*
+ * Lower bound, in O(L), on the length getBestInsertion adds to a route: the
+ * cheapest place for the pickup alone and for the delivery alone, as with
+ * shortest path distances neither stop makes the other cheaper to insert.
+ * 0 if the delivery is already in the route, since getMin may then shorten
+ * it.
+ */
+template<class T>
+double DeliverySystem<T>::getInsertionLowerBound(const DistanceMatrix<T> &d, const RouteEnds &ends, const vector<unsigned int> &path, unsigned int pickup, unsigned int delivery) const{
+	double minP = INF, minD = INF;
+	unsigned int prev = ends.start;
+	for(size_t k = 0; k <= path.size(); k++){
+		unsigned int to = (k == path.size()) ? ends.end : path[k];
+		if(k < path.size() && to == delivery)
+			return 0;
+		minP = std::min(minP, d.get(prev, pickup) + d.get(pickup, to) - d.get(prev, to));
+		minD = std::min(minD, d.get(prev, delivery) + d.get(delivery, to) - d.get(prev, to));
+		prev = to;
+	}
+	return std::max(minP, minD);
+}
+
+/*
+ * Scores a request in every vehicle allowed (all if allowed is empty), into
+ * candidate as getBestInsertion does, cost (the new route's cost to its
+ * vehicle, see RouteProfile) and v_dist; the others are left at INF. Vehicles are taken by a lower bound on the fleet objective they
+ * would give, and one whose bound is already above the best vehicle scored,
+ * by more than selectVehicle's tolerance, is left at INF unscored: it could
+ * not have been picked.
+ */
+template<class T>
+void DeliverySystem<T>::scoreVehicles(const DistanceMatrix<T> &d, const vector<vector<unsigned int>> &routes, const FleetCost &fleet, const FleetSchedule<T> &schedule, const vector<bool> &allowed, unsigned int pickup, unsigned int delivery, size_t r,
+		vector<double> &cost, vector<double> &v_dist, vector<vector<unsigned int>> &candidate, ThreadPool &pool, InsertionStats &stats) const{
+	size_t V = routes.size();
+	InsertionScratch &scratch = insertionScratch();
+	vector<double> &bound = scratch.bound;
+	vector<unsigned int> &order = scratch.order;
+	bound.assign(V, 0);
+	order.clear();
+	for(unsigned int b = 0; b < V; b++){
+		if(!allowed.empty() && !allowed[b]){
+			cost[b] = v_dist[b] = INF;
+			continue;
+		}
+		double added = getInsertionLowerBound(d, schedule.getEnds(b), routes[b], pickup, delivery);
+		bound[b] = (this->*calculateVehiclesPtr)(fleet, b, schedule.getProfile(b).grown(fleet.getCost(b), added, !routes[b].empty()), false);
+		order.push_back(b);
+	}
+	if(order.empty())
+		return;
+	stable_sort(order.begin(), order.end(), [&](unsigned int x, unsigned int y){return bound[x] < bound[y];});
+	auto limitOf = [](double best){
+		return best + 2 * (best * 1e-9 + 1e-9);
+	};
+
+	vector<InsertionStats> &counts = scratch.counts;
+	counts.assign(V, InsertionStats());
+	auto evaluate = [&](size_t b){
+		cost[b] = schedule.getProfile(b).cost(getBestInsertion(d, schedule, b, routes[b], pickup, delivery, r, candidate[b], &counts[b]), true);
+		v_dist[b] = (this->*calculateVehiclesPtr)(fleet, b, cost[b], false);
+	};
+	auto prune = [&](size_t b){
+		cost[b] = v_dist[b] = INF;
+		stats.prunedVehicles++;
+	};
+	size_t work = 0;
+	for(unsigned int b : order)
+		work += (routes[b].size() + 1) * (routes[b].size() + 2) / 2;
+	if(work >= PARALLEL_MIN_WORK){
+		//the most promising vehicle sets the limit for the others
+		evaluate(order[0]);
+		double limit = limitOf(v_dist[order[0]]);
+		vector<unsigned int> &rest = scratch.rest;
+		rest.clear();
+		for(size_t j = 1; j < order.size(); j++){
+			if(bound[order[j]] > limit)
+				prune(order[j]);
+			else
+				rest.push_back(order[j]);
+		}
+		pool.parallelFor(rest.size(), [&](size_t j){evaluate(rest[j]);});
+	}
+	else{
+		double limit = INF;
+		for(unsigned int b : order){
+			if(bound[b] > limit){
+				prune(b);
+				continue;
+			}
+			evaluate(b);
+			limit = std::min(limit, limitOf(v_dist[b]));
+		}
+	}
+	stats.vehicles += order.size();
+	for(unsigned int b = 0; b < V; b++)
+		stats += counts[b];
+}
 
 template<class T>
 void DeliverySystem<T>::newAlgorithm2(string str){
+	MatrixStats matrix = stats.matrix;
+	stats = newAlgorithm2(str, distances, numThreads);
+	stats.matrix = matrix;
+}
 
-	//cout << processedMap.getWeight(2 , 2) <<endl;
+template<class T>
+RequestConstraint DeliverySystem<T>::getConstraint(const Request<T> &request){
+	RequestConstraint c;
+	c.load = request.getLoad();
+	c.pickupEarliest = request.getPickupEarliest();
+	c.pickupLatest = request.getPickupLatest();
+	c.deliveryEarliest = request.getDeliveryEarliest();
+	c.deliveryLatest = request.getDeliveryLatest();
+	return c;
+}
 
-	//Reset vehicles
-	vector<Vehicle<T>*> currentVehicles = getVehicles(str);
-	for(unsigned int a = 0; a < currentVehicles.size();a++)
-		currentVehicles.at(a)->reset();
+template<class T>
+T DeliverySystem<T>::getStartNode(const Vehicle<T> &vehicle) const{
+	return vehicle.hasDepots() ? vehicle.getStartNode() : origNode;
+}
 
-	if(currentVehicles.size() == 0)
-		return;
+template<class T>
+T DeliverySystem<T>::getEndNode(const Vehicle<T> &vehicle) const{
+	return vehicle.hasDepots() ? vehicle.getEndNode() : origNode;
+}
 
-	vector<Request<T>> currentRequests = getValidRequest(str);
+/*
+ * Start and end depots of the vehicles of a specialty ("" for all) that have
+ * their own, repeats included.
+ */
+template<class T>
+vector<T> DeliverySystem<T>::getDepots(string str) const{
+	vector<T> v;
+	for(size_t i = 0; i < vehicles.size(); i++)
+		if((str == "" || vehicles[i].getSpecialty() == str) && vehicles[i].hasDepots()){
+			v.push_back(vehicles[i].getStartNode());
+			v.push_back(vehicles[i].getEndNode());
+		}
+	return v;
+}
 
-	for(unsigned int r = 0; r < currentRequests.size(); r++){
+/*
+ * Depot slots of the given vehicles, which must all be in the matrix.
+ */
+template<class T>
+vector<RouteEnds> DeliverySystem<T>::getRouteEnds(const DistanceMatrix<T> &d, const vector<Vehicle<T> *> &v) const{
+	vector<RouteEnds> ends(v.size());
+	for(size_t b = 0; b < v.size(); b++){
+		ends[b].start = d.getSlot(getStartNode(*v[b]));
+		ends[b].end = d.getSlot(getEndNode(*v[b]));
+	}
+	return ends;
+}
 
-		unsigned int min_vehicle = -1;
-		double min_dist = INF;
-		vector<T> min_path;
+/*
+ * Speed, longest duration and costs of the given vehicles.
+ */
+template<class T>
+vector<RouteProfile> DeliverySystem<T>::getRouteProfiles(const vector<Vehicle<T> *> &v){
+	vector<RouteProfile> profiles(v.size());
+	for(size_t b = 0; b < v.size(); b++){
+		profiles[b].pace = 1 / v[b]->getSpeed();
+		profiles[b].maxDuration = v[b]->getMaxDuration();
+		profiles[b].fixedCost = v[b]->getFixedCost();
+		profiles[b].distanceCost = v[b]->getDistanceCost();
+	}
+	return profiles;
+}
 
-		for(unsigned int b = 0; b < currentVehicles.size();b++){
+/*
+ * Whether a vehicle with some of the given ends (the origin if none) can
+ * drive from its start depot to the pickup, on to the delivery and back to
+ * its end depot.
+ */
+template<class T>
+bool DeliverySystem<T>::isServable(const DistanceMatrix<T> &d, const vector<RouteEnds> &ends, unsigned int pickup, unsigned int delivery){
+	vector<RouteEnds> all = ends.empty() ? vector<RouteEnds>(1) : ends;
+	for(const RouteEnds &e : all)
+		if(d.get(e.start, pickup) != INF && d.get(pickup, delivery) != INF && d.get(delivery, e.end) != INF)
+			return true;
+	return false;
+}
 
-			vector<T> path = currentVehicles.at(b)->getPath();
+/*
+ * Groups the vehicles by their ends and, when there are several groups and
+ * setNearestDepot is on, pre-assigns each request to the group that would
+ * serve it alone the cheapest: the closest start depot to its pickup plus
+ * the closest end depot from its delivery, both read off the depot rows and
+ * columns of the matrix (first group on ties).
+ */
+template<class T>
+DepotGroups DeliverySystem<T>::assignDepots(const DistanceMatrix<T> &d, const vector<RouteEnds> &ends, const vector<pair<unsigned int, unsigned int>> &slots) const{
+	DepotGroups depots;
+	vector<RouteEnds> groups;
+	for(const RouteEnds &e : ends){
+		size_t g = find(groups.begin(), groups.end(), e) - groups.begin();
+		if(g == groups.size())
+			groups.push_back(e);
+		depots.group.push_back(g);
+	}
+	depots.home.assign(slots.size(), -1);
+	if(!nearestDepot || groups.size() < 2)
+		return depots;
+	for(size_t r = 0; r < slots.size(); r++){
+		double best = INF;
+		for(size_t g = 0; g < groups.size(); g++){
+			double to = d.get(groups[g].start, slots[r].first), back = d.get(slots[r].second, groups[g].end);
+			if(to == INF || back == INF || to + back >= best)
+				continue;
+			best = to + back;
+			depots.home[r] = g;
+		}
+	}
+	return depots;
+}
 
-			double min = INF;
-			vector<T> next;
+/*
+ * Vehicle whose route costing cost[b] gives the lowest fleet objective, given
+ * v_dist[b] as scored incrementally. Vehicles within rounding distance of the
+ * best are compared on the exact objective, so ties are broken as a full
+ * rescore would: the first minimum in vehicle order wins. -1 if no vehicle
+ * can take the request.
+ */
+template<class T>
+unsigned int DeliverySystem<T>::selectVehicle(const FleetCost &fleet, const vector<double> &cost, const vector<double> &v_dist) const{
+	unsigned int min_vehicle = -1;
+	double min_dist = INF;
+	double best = INF;
+	for(unsigned int b = 0; b < cost.size();b++)
+		best = std::min(best, v_dist[b]);
+	double tolerance = best * 1e-9 + 1e-9;
+	for(unsigned int b = 0; b < cost.size();b++){
+		if(v_dist[b] > best + tolerance)
+			continue;
+		double dist = (this->*calculateVehiclesPtr)(fleet, b, cost[b], true);
+		if(dist < min_dist){
+			min_dist = dist;
+			min_vehicle = b;
+		}
+	}
+	return min_vehicle;
+}
 
-			//inserir inicio
-			for(unsigned int a = 0; a < path.size() ; a++){
-				double dista = INF;
-				vector<T> temp = path;
-				temp.insert(temp.begin() + a , currentRequests[r].getInicio());
+/*
+ * Inserts the requests that have no vehicle yet in input order, each into
+ * the vehicle where it costs least, among the vehicles of its depots if it
+ * has been pre-assigned and one of them can take it. getBestInsertion is
+ * const, so vehicles can be scored concurrently, each into its own slot;
+ * the winner is then picked serially in vehicle order.
+ */
+template<class T>
+InsertionStats DeliverySystem<T>::insertInOrder(const DistanceMatrix<T> &d, vector<vector<unsigned int>> &routes, FleetCost &fleet, const vector<pair<unsigned int, unsigned int>> &slots, vector<int> &owner, FleetSchedule<T> &schedule, const DepotGroups &depots, ThreadPool &pool) const{
+	vector<double> cost(routes.size());
+	vector<double> v_dist(routes.size());
+	vector<vector<unsigned int>> candidate(routes.size());
+	vector<bool> allowed;
+	InsertionStats stats;
+
+	for(unsigned int r = 0; r < slots.size(); r++){
+		if(owner[r] != -1)
+			continue;
+		depots.candidates(r, allowed);
+		scoreVehicles(d, routes, fleet, schedule, allowed, slots[r].first, slots[r].second, r, cost, v_dist, candidate, pool, stats);
+
+		unsigned int min_vehicle = selectVehicle(fleet, cost, v_dist);
+		if(min_vehicle == (unsigned int)-1 && !allowed.empty()){
+			allowed.clear();
+			scoreVehicles(d, routes, fleet, schedule, allowed, slots[r].first, slots[r].second, r, cost, v_dist, candidate, pool, stats);
+			min_vehicle = selectVehicle(fleet, cost, v_dist);
+		}
+		if(min_vehicle == (unsigned int)-1)
+			continue;
+		routes.at(min_vehicle).swap(candidate.at(min_vehicle));
+		fleet.update(min_vehicle, cost[min_vehicle]);
+		schedule.assign(r, min_vehicle, routes[min_vehicle]);
+		owner[r] = min_vehicle;
+	}
+	return stats;
+}
 
-				currentVehicles.at(b)->setPath(temp);
-				if(calculatePathWeight(temp) > min)
-					continue;
-				T value = currentRequests[r].getFim();
-				dista = getMin(temp,a,value,r);
-				if(dista < min){
-					min = dista;
-					next = temp;
-				}
+/*
+ * Regret-k insertion. The new route cost of every pending request in every
+ * vehicle is cached, so after an insertion only the column of the vehicle
+ * that changed is scored again. A request's regret is the sum of the fleet
+ * objective of its k best vehicles over its best one; a heap keyed by regret
+ * (ties: input order) gives the next request, which then goes to its best
+ * vehicle as in insertInOrder (or is left out if none can take it). Regrets
+ * are rescored from the cache, and only requests whose regret changed get a
+ * new heap entry; stale entries are skipped by version. Every vehicle is
+ * scored, as the regret needs the k best, so only pickup places are pruned.
+ * A pre-assigned request is only scored in the vehicles of its depots, until
+ * none of them can take it.
+ */
+template<class T>
+InsertionStats DeliverySystem<T>::insertByRegret(const DistanceMatrix<T> &d, vector<vector<unsigned int>> &routes, FleetCost &fleet, const vector<pair<unsigned int, unsigned int>> &slots, vector<int> &owner, FleetSchedule<T> &schedule, const DepotGroups &depots, ThreadPool &pool) const{
+	DepotGroups home = depots;
+	size_t V = routes.size();
+	vector<double> added(slots.size() * V);	// cost of vehicle b with request u, at u*V+b
+	vector<double> regret(slots.size(), 0);
+	vector<unsigned int> version(slots.size(), 0);
+	vector<InsertionStats> counts(slots.size());
+	vector<unsigned int> pending;
+	for(unsigned int u = 0; u < slots.size(); u++)
+		pending.push_back(u);
+
+	//(regret, -request, version): highest regret first, then input order
+	typedef tuple<double, long, unsigned int> Entry;
+	priority_queue<Entry> heap;
+
+	auto score = [&](unsigned int u, size_t b){
+		if(!home.allows(u, b)){
+			added[u*V+b] = INF;
+			return;
+		}
+		vector<unsigned int> &next = insertionScratch().route;
+		added[u*V+b] = schedule.getProfile(b).cost(getBestInsertion(d, schedule, b, routes[b], slots[u].first, slots[u].second, u, next, &counts[u]), true);
+		counts[u].vehicles++;
+	};
+	auto regretOf = [&](unsigned int u){
+		vector<double> &dist = insertionScratch().dist;
+		dist.resize(V);
+		for(size_t b = 0; b < V; b++)
+			dist[b] = (this->*calculateVehiclesPtr)(fleet, b, added[u*V+b], false);
+		size_t k = std::min<size_t>(regretK, V);
+		partial_sort(dist.begin(), dist.begin() + k, dist.end());
+		if(dist[0] >= INF)
+			return 0.0;
+		double sum = 0;
+		for(size_t j = 1; j < k; j++)
+			sum += dist[j] - dist[0];
+		return sum;
+	};
+	auto push = [&](unsigned int u){
+		heap.push(Entry(regret[u], -(long)u, version[u]));
+	};
+
+	pool.parallelFor(slots.size(), [&](size_t u){
+		for(size_t b = 0; b < V; b++)
+			score(u, b);
+	});
+	for(unsigned int u = 0; u < slots.size(); u++){
+		regret[u] = regretOf(u);
+		push(u);
+	}
+
+	vector<double> cost(V);
+	vector<double> v_dist(V);
+	vector<unsigned int> next;
+	while(!pending.empty()){
+		unsigned int u = -get<1>(heap.top());
+		bool stale = owner[u] != -1 || get<2>(heap.top()) != version[u];
+		heap.pop();
+		if(stale)
+			continue;
+
+		auto select = [&](){
+			for(size_t b = 0; b < V; b++){
+				cost[b] = added[u*V+b];
+				v_dist[b] = (this->*calculateVehiclesPtr)(fleet, b, cost[b], false);
 			}
-			vector<T> temp = path;
-			temp.push_back(currentRequests[r].getInicio());
-			temp.push_back(currentRequests[r].getFim());
-			double dist_p = calculatePathWeight(temp);
-			if(dist_p < min){
-				min = dist_p;
-				next = temp;
+			return selectVehicle(fleet, cost, v_dist);
+		};
+		unsigned int min_vehicle = select();
+		if(min_vehicle == (unsigned int)-1 && home.home[u] != -1){
+			home.home[u] = -1;
+			for(size_t b = 0; b < V; b++)
+				if(home.group[b] != depots.home[u])
+					score(u, b);
+			min_vehicle = select();
+		}
+		pending.erase(find(pending.begin(), pending.end(), u));
+		if(min_vehicle == (unsigned int)-1)
+			continue;	//fits no vehicle, and later insertions only make that worse
+		getBestInsertion(d, schedule, min_vehicle, routes[min_vehicle], slots[u].first, slots[u].second, u, next);
+		routes.at(min_vehicle).swap(next);
+		fleet.update(min_vehicle, cost[min_vehicle]);
+		schedule.assign(u, min_vehicle, routes[min_vehicle]);
+		owner[u] = min_vehicle;
+
+		//only the column of min_vehicle is out of date
+		auto evaluate = [&](size_t i){score(pending[i], min_vehicle);};
+		size_t L = routes[min_vehicle].size();
+		if(pending.size() * (L + 1) * (L + 2) / 2 >= PARALLEL_MIN_WORK)
+			pool.parallelFor(pending.size(), evaluate);
+		else
+			for(size_t i = 0; i < pending.size(); i++)
+				evaluate(i);
+
+		for(unsigned int w : pending){
+			double value = regretOf(w);
+			if(value != regret[w]){
+				regret[w] = value;
+				version[w]++;
+				push(w);
 			}
-			currentVehicles.at(b)->setPath(next);
+		}
+		//drop the stale entries once they outnumber the live ones
+		if(heap.size() > 4 * pending.size() + 16){
+			heap = priority_queue<Entry>();
+			for(unsigned int w : pending)
+				push(w);
+		}
+	}
+	InsertionStats stats;
+	for(const InsertionStats &c : counts)
+		stats += c;
+	return stats;
+}
 
-			double v_dist = (this->*calculateVehiclesPtr)(str);
+/*
+ * Inserts the requests (slots, constraints) into the routes of the vehicles
+ * (capacity, ends, profiles), each vehicle leaving from and returning to its
+ * depots
+ * (see assignDepots for which vehicles a request is offered to), then
+ * improves the routes with ruin and recreate (if set) and local search,
+ * with workShare of their iteration and move budgets and timeShare of their
+ * time budgets. owner gets the vehicle of every request, -1 where none
+ * could take it. While a SolverHandle runs, the routes are published as
+ * vehicles index as they improve.
+ */
+template<class T>
+SolverStats DeliverySystem<T>::solveRoutes(const DistanceMatrix<T> &matrix, vector<vector<unsigned int>> &routes, FleetCost &fleet, const vector<pair<unsigned int, unsigned int>> &slots, vector<int> &owner,
+		const vector<RequestConstraint> &constraints, const vector<double> &capacity, const vector<RouteEnds> &ends, const vector<RouteProfile> &profiles, const vector<unsigned int> &index,
+		ThreadPool &pool, double workShare, double timeShare) const{
+	FleetSchedule<T> schedule(matrix, slots, constraints, capacity, ends, profiles);
+	schedule.reset(routes, owner);
+	DepotGroups depots = assignDepots(matrix, ends, slots);
+
+	SolverStats result;
+	if(regretK >= 2)
+		result.insertion = insertByRegret(matrix, routes, fleet, slots, owner, schedule, depots, pool);
+	else
+		result.insertion = insertInOrder(matrix, routes, fleet, slots, owner, schedule, depots, pool);
+	publish(matrix, index, routes, ends, profiles);
+
+	vector<unsigned int> served;
+	for(unsigned int r = 0; r < slots.size(); r++)
+		if(owner[r] != -1)
+			served.push_back(r);
+
+	auto objective = [this](const FleetCost &f){
+		return (this->*calculateVehiclesPtr)(f, 0, f.getCost(0), false);
+	};
+	if(lnsMaxIterations > 0 || lnsMaxMillis > 0){
+		LargeNeighbourhoodSearch<T> lns(matrix, objective);
+		vector<int> servedOwner;
+		for(unsigned int r : served){
+			lns.addRequest(slots[r].first, slots[r].second, constraints[r]);
+			servedOwner.push_back(owner[r]);
+		}
+		lns.setCapacities(capacity);
+		lns.setEnds(ends);
+		lns.setProfiles(profiles);
+		if(board != nullptr)
+			lns.setProgress(stopFlag, [&](const vector<vector<unsigned int>> &best){publish(matrix, index, best, ends, profiles);});
+		result.lns = lns.run(routes, servedOwner, pool, lnsSeed, ceil(lnsMaxIterations * workShare), lnsMaxMillis * timeShare);
+		for(size_t j = 0; j < served.size(); j++)
+			owner[served[j]] = servedOwner[j];
+		for(unsigned int b = 0; b < routes.size();b++)
+			fleet.update(b, calculateRouteCost(matrix, routes[b], ends[b], profiles[b]));
+	}
+	if(lsMaxMoves > 0){
+		LocalSearch<T> search(matrix, routes, fleet, objective);
+		for(unsigned int r : served)
+			search.addRequest(slots[r].first, slots[r].second, owner[r], constraints[r]);
+		search.setCapacities(capacity);
+		search.setEnds(ends);
+		search.setProfiles(profiles);
+		auto last = chrono::steady_clock::now();
+		if(board != nullptr)
+			search.setProgress(stopFlag, [&](){
+				if(chrono::duration<double, milli>(chrono::steady_clock::now() - last).count() >= SNAPSHOT_MIN_MILLIS){
+					publish(matrix, index, routes, ends, profiles);
+					last = chrono::steady_clock::now();
+				}
+			});
+		result.localSearch = search.run(ceil(lsMaxMoves * workShare), lsMaxMillis * timeShare);
+		for(size_t j = 0; j < served.size(); j++)
+			owner[served[j]] = search.getRoute(j);
+		publish(matrix, index, routes, ends, profiles);
+	}
+	return result;
+}
+
+/*
+ * Hands the routes of the vehicles index to the running SolverHandle, if any.
+ */
+template<class T>
+void DeliverySystem<T>::publish(const DistanceMatrix<T> &matrix, const vector<unsigned int> &index, const vector<vector<unsigned int>> &routes, const vector<RouteEnds> &ends,
+		const vector<RouteProfile> &profiles) const{
+	if(board == nullptr)
+		return;
+	vector<vector<T>> paths(routes.size());
+	vector<double> costs(routes.size());
+	for(size_t b = 0; b < routes.size(); b++){
+		paths[b] = matrix.toNodes(routes[b]);
+		costs[b] = calculateRouteCost(matrix, routes[b], ends[b], profiles[b]);
+	}
+	board->update(index, paths, costs);
+}
 
-			if(v_dist < min_dist){
-				min_dist = v_dist;
-				min_vehicle = b;
-				min_path = next;
+/*
+ * Assigns the valid requests of a specialty to its vehicles, using the given
+ * distance matrix (see solveRoutes). With clusters set, each group of
+ * requests is solved with its share of the vehicles in its own thread, and
+ * the requests none of those could take are then offered to the whole
+ * fleet. Only those vehicles are written, so specialties can be solved
+ * concurrently.
+ */
+template<class T>
+SolverStats DeliverySystem<T>::newAlgorithm2(string str, const DistanceMatrix<T> &matrix, unsigned int threads){
+
+	//cout << processedMap.getWeight(2 , 2) <<endl;
+
+	//Reset vehicles
+	vector<Vehicle<T>*> currentVehicles = getVehicles(str);
+	for(unsigned int a = 0; a < currentVehicles.size();a++)
+		currentVehicles.at(a)->reset();
+
+	if(currentVehicles.size() == 0)
+		return SolverStats();
+
+	vector<Request<T>> currentRequests = getValidRequest(str);
+
+	//Routes as matrix slots, copied back to the vehicles at the end
+	vector<vector<unsigned int>> routes(currentVehicles.size());
+	FleetCost fleet;
+	fleet.reset(routes.size());
+
+	vector<pair<unsigned int, unsigned int>> slots;	// of each request
+	vector<int> owner(currentRequests.size(), -1);
+	for(unsigned int r = 0; r < currentRequests.size(); r++)
+		slots.push_back(make_pair(matrix.getSlot(currentRequests[r].getInicio()), matrix.getSlot(currentRequests[r].getFim())));
+
+	vector<RequestConstraint> constraints(currentRequests.size());
+	for(unsigned int r = 0; r < currentRequests.size(); r++)
+		constraints[r] = getConstraint(currentRequests[r]);
+	vector<double> capacity(currentVehicles.size());
+	for(unsigned int b = 0; b < currentVehicles.size(); b++)
+		capacity[b] = currentVehicles[b]->getCapacity();
+	vector<RouteEnds> ends = getRouteEnds(matrix, currentVehicles);
+	vector<RouteProfile> profiles = getRouteProfiles(currentVehicles);
+	for(unsigned int b = 0; b < routes.size(); b++)
+		fleet.update(b, calculateRouteCost(matrix, routes[b], ends[b], profiles[b]));
+	vector<unsigned int> index;	// in vehicles
+	for(unsigned int b = 0; b < currentVehicles.size(); b++)
+		index.push_back(currentVehicles[b] - &vehicles[0]);
+
+	SolverStats result;
+	vector<vector<unsigned int>> vehiclesOf, requestsOf;
+	auto start = chrono::steady_clock::now();
+	if(!clusterRequests(currentVehicles, currentRequests, vehiclesOf, requestsOf)){
+		ThreadPool pool(routes.size() > 1 ? threads : 1);
+		result = solveRoutes(matrix, routes, fleet, slots, owner, constraints, capacity, ends, profiles, index, pool);
+	}else{
+		unsigned int K = vehiclesOf.size();
+		unsigned int cores = threads ? threads : max(thread::hardware_concurrency(), 1u);
+		vector<SolverStats> partial(K);
+		vector<vector<vector<unsigned int>>> groupRoutes(K);
+		vector<FleetCost> groupFleet(K);
+		vector<vector<int>> groupOwner(K);
+
+		//every group copies out its requests and vehicles, so groups share nothing but the matrix
+		ThreadPool groups(min(cores, K));
+		groups.parallelFor(K, [&](size_t c){
+			const vector<unsigned int> &vs = vehiclesOf[c], &rs = requestsOf[c];
+			vector<pair<unsigned int, unsigned int>> s;
+			vector<RequestConstraint> con;
+			for(unsigned int r : rs){
+				s.push_back(slots[r]);
+				con.push_back(constraints[r]);
+			}
+			vector<double> cap;
+			vector<RouteEnds> e;
+			vector<RouteProfile> pro;
+			vector<unsigned int> in;
+			groupFleet[c].reset(vs.size());
+			for(size_t j = 0; j < vs.size(); j++){
+				cap.push_back(capacity[vs[j]]);
+				e.push_back(ends[vs[j]]);
+				pro.push_back(profiles[vs[j]]);
+				in.push_back(index[vs[j]]);
+				groupFleet[c].update(j, fleet.getCost(vs[j]));
+			}
+			groupRoutes[c].resize(vs.size());
+			groupOwner[c].assign(rs.size(), -1);
+			ThreadPool pool(vs.size() > 1 ? max(cores / K, 1u) : 1);
+			//the improvement budgets are shared out, so the whole run takes as long as before
+			double work = (double)rs.size() / slots.size();
+			double time = (double)min(cores, K) / K;
+			partial[c] = solveRoutes(matrix, groupRoutes[c], groupFleet[c], s, groupOwner[c], con, cap, e, pro, in, pool, work, time);
+		});
+
+		unsigned long left = 0;
+		for(unsigned int c = 0; c < K; c++){
+			result += partial[c];
+			result.clusters.largest = max<unsigned long>(result.clusters.largest, requestsOf[c].size());
+			for(size_t j = 0; j < vehiclesOf[c].size(); j++){
+				routes[vehiclesOf[c][j]].swap(groupRoutes[c][j]);
+				fleet.update(vehiclesOf[c][j], groupFleet[c].getCost(j));
 			}
-			currentVehicles.at(b)->setPath(path);
+			for(size_t i = 0; i < requestsOf[c].size(); i++)
+				if(groupOwner[c][i] != -1)
+					owner[requestsOf[c][i]] = vehiclesOf[c][groupOwner[c][i]];
+				else
+					left++;
 		}
-		/*cout <<"BEST : ";
-		for(size_t i = 0; i < min_path.size();i++)
-			cout<<min_path[i]<<"  ";
-		cout<<"   "<<min_dist<<endl;
-		cout<<endl;*/
-		currentVehicles.at(min_vehicle)->setPath(min_path);
+		if(left > 0){
+			FleetSchedule<T> schedule(matrix, slots, constraints, capacity, ends, profiles);
+			schedule.reset(routes, owner);
+			DepotGroups depots = assignDepots(matrix, ends, slots);
+			ThreadPool pool(routes.size() > 1 ? threads : 1);
+			result.insertion += insertInOrder(matrix, routes, fleet, slots, owner, schedule, depots, pool);
+			result.clusters.outside = left - count(owner.begin(), owner.end(), -1);
+			publish(matrix, index, routes, ends, profiles);
+		}
+		result.clusters.clusters = K;
+		result.clusters.millis = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	//requests no vehicle could take are reported as impossible, and left out
+	for(unsigned int r = 0, i = 0; i < requests.size(); i++)
+		if(str == "" || requests[i].getEspecialidade() == str){
+			requests[i].setVehicle(-1);
+			if(!requests[i].isValid())
+				continue;
+			if(owner[r] == -1)
+				requests[i].setValid(false);
+			else
+				requests[i].setVehicle(index[owner[r]]);
+			r++;
+		}
+
+	for(unsigned int b = 0; b < routes.size();b++){
+		currentVehicles.at(b)->setPath(matrix.toNodes(routes[b]));
+		currentVehicles.at(b)->setRouteCost(fleet.getCost(b));
+		currentVehicles.at(b)->setRouteLength(calculatePathWeight(matrix, routes[b], ends[b]));
+	}
+	return result;
+}
+
+/*
+ * Splits the requests into clusterCount groups (fewer with fewer vehicles or
+ * requests), by the sweep angle of the middle of their pickup and delivery
+ * around the origin, or by k-means on their pickup and delivery
+ * coordinates. Vehicles are shared out in proportion to the requests of each
+ * group, at least one each, and each goes to the group, among those with
+ * room left, whose pickups are closest on average to its start depot.
+ * False, with nothing split, when clusters are off or a point has no
+ * coordinates.
+ */
+template<class T>
+bool DeliverySystem<T>::clusterRequests(const vector<Vehicle<T> *> &v, const vector<Request<T>> &r, vector<vector<unsigned int>> &vehiclesOf, vector<vector<unsigned int>> &requestsOf) const{
+	unsigned int K = min<size_t>(clusterCount, min(v.size(), r.size()));
+	if(K < 2)
+		return false;
+
+	auto position = [this](T node, pair<double, double> &p){
+		Vertex<T> *vertex = originalMap.findVertex(node);
+		if(vertex == nullptr || !vertex->hasPosition())
+			return false;
+		p = make_pair(vertex->getX(), vertex->getY());
+		return true;
+	};
+	vector<pair<double, double>> pickup(r.size()), delivery(r.size()), start(v.size());
+	pair<double, double> origin;
+	if(!position(origNode, origin))
+		return false;
+	for(size_t i = 0; i < r.size(); i++)
+		if(!position(r[i].getInicio(), pickup[i]) || !position(r[i].getFim(), delivery[i]))
+			return false;
+	for(size_t b = 0; b < v.size(); b++)
+		if(!position(getStartNode(*v[b]), start[b]))
+			return false;
+
+	vector<unsigned int> cluster;
+	if(clusterByKMeans){
+		vector<vector<double>> points;
+		for(size_t i = 0; i < r.size(); i++)
+			points.push_back({pickup[i].first, pickup[i].second, delivery[i].first, delivery[i].second});
+		cluster = kMeansClusters(points, K);
+	}else{
+		vector<pair<double, double>> points;
+		for(size_t i = 0; i < r.size(); i++)
+			points.push_back(make_pair((pickup[i].first + delivery[i].first) / 2, (pickup[i].second + delivery[i].second) / 2));
+		cluster = sweepClusters(points, origin.first, origin.second, K);
 	}
 
+	//k-means may leave a cluster empty: number the others from 0
+	vector<int> index(K, -1);
+	requestsOf.clear();
+	for(size_t i = 0; i < r.size(); i++){
+		if(index[cluster[i]] == -1){
+			index[cluster[i]] = requestsOf.size();
+			requestsOf.push_back(vector<unsigned int>());
+		}
+		requestsOf[index[cluster[i]]].push_back(i);
+	}
+	K = requestsOf.size();
+	if(K < 2)
+		return false;
+
+	//one vehicle each, the rest by highest average (d'Hondt)
+	vector<unsigned int> quota(K, 1);
+	for(size_t extra = K; extra < v.size(); extra++){
+		unsigned int best = 0;
+		for(unsigned int c = 1; c < K; c++)
+			if(requestsOf[c].size() * (quota[best] + 1) > requestsOf[best].size() * (quota[c] + 1))
+				best = c;
+		quota[best]++;
+	}
+	vector<pair<double, double>> centre(K, make_pair(0.0, 0.0));
+	for(unsigned int c = 0; c < K; c++){
+		for(unsigned int i : requestsOf[c]){
+			centre[c].first += pickup[i].first / requestsOf[c].size();
+			centre[c].second += pickup[i].second / requestsOf[c].size();
+		}
+	}
+	vehiclesOf.assign(K, vector<unsigned int>());
+	for(unsigned int b = 0; b < v.size(); b++){
+		int best = -1;
+		double bestDist = INF;
+		for(unsigned int c = 0; c < K; c++){
+			if(vehiclesOf[c].size() == quota[c])
+				continue;
+			double dx = centre[c].first - start[b].first, dy = centre[c].second - start[b].second;
+			if(dx * dx + dy * dy < bestDist){
+				bestDist = dx * dx + dy * dy;
+				best = c;
+			}
+		}
+		vehiclesOf[best].push_back(b);
+	}
+	return true;
 }
 
 template<class T>
@@ -382,7 +1527,7 @@ template<class T>
 vector<Request<T>> DeliverySystem<T>::getValidRequest(string str)const{
 	vector<Request<T>> v;
 	for(size_t i = 0; i < requests.size();i++)
-		if(requests[i].isValid() && (str == "" || requests[i].getEspecialidade() == str))
+		if((str == "" || requests[i].getEspecialidade() == str) && requests[i].isValid())
 			v.push_back(requests[i]);
 	return v;
 }
@@ -403,9 +1548,16 @@ vector<Vertex<T> *> DeliverySystem<T>::getPath(T destNode){
 template<class T>
 vector<Request<T>> DeliverySystem<T>::getRequests() const{return requests;}
 template<class T>
-void DeliverySystem<T>::addRequest(Request<T> r){requests.push_back(r);}
+void DeliverySystem<T>::addRequest(Request<T> r){
+	requests.push_back(r);
+	if(online && !onlineDistances.empty())
+		dispatches.push_back(dispatch(requests.size() - 1));
+}
 template<class T>
-void DeliverySystem<T>::addRequests(vector<Request<T>> vr){ requests.append(vr);}
+void DeliverySystem<T>::addRequests(vector<Request<T>> vr){
+	for(size_t i = 0; i < vr.size();i++)
+		addRequest(vr[i]);
+}
 template<class T>
 void DeliverySystem<T>::setRequests(vector<Request<T>> vr){requests = vr;}
 
@@ -436,7 +1588,7 @@ template<class T>
 vector<T> DeliverySystem<T>::getPickupPoints(string str) const{
 	vector<T> v;
 	for(unsigned int i = 0; i < requests.size();i++)
-		if(requests[i].isValid() && requests[i].getEspecialidade() == str)
+		if(requests[i].getEspecialidade() == str && requests[i].isValid())
 			v.push_back(requests[i].getInicio());
 	return v;
 }
@@ -444,7 +1596,7 @@ template<class T>
 vector<T> DeliverySystem<T>::getDeliverPoints(string str) const{
 	vector<T> v;
 	for(unsigned int i = 0; i < requests.size();i++)
-		if(requests[i].isValid() && requests[i].getEspecialidade() == str)
+		if(requests[i].getEspecialidade() == str && requests[i].isValid())
 			v.push_back(requests[i].getFim());
 	return v;
 }
@@ -466,94 +1618,63 @@ vector<vector<T>> DeliverySystem<T>::getVehiclesPath() const{
 	return paths;
 }
 
+/*
+ * Expands a route of interest points, from and back to origNode, into the
+ * vertices it drives through, written to out. Legs are read from the trees
+ * kept by the searches behind the distance matrices, so this costs the
+ * length of the output; a leg they do not hold yet is searched for once. An
+ * empty route stays at the origin.
+ */
 template<class T>
-vector<vector<T>> DeliverySystem<T>::getVehiclesCompletePath(){
-	vector<vector<T>> paths;
+void DeliverySystem<T>::expandPath(const vector<T> &path, vector<T> &out){
+	expandPath(path, out, origNode, origNode);
+}
 
-		for(unsigned int a = 0; a < vehicles.size();a++){
-			string str = vehicles[a].getSpecialty();
-			setProcessedMap(str);
-			vector<T> p = vehicles[a].getPath();
-			vector<T> path;
-			if(p.size()>0){
-				vector<Vertex<T> *> subs = processedMap.findVertex(origNode)->getProcessedEdge(processedMap.findVertex(p[0]));
-				if(path.size()>0)
-					path.pop_back();
-				for(size_t c = 0; c < subs.size();c++){
-					path.push_back(subs[c]->getInfo());
-				}
-			}else{
-				path.push_back(origNode);
-				path.push_back(origNode);
-				paths.push_back(path);
-				continue;
-			}
-			for(size_t b = 1; b < p.size();b++){
-				//cout<<p[b-1]<<" -> " << p[b] << "  :  ";
-				vector<Vertex<T> *> subs = processedMap.findVertex(p[b-1])->getProcessedEdge(processedMap.findVertex(p[b]));
-				if(path.size()>0)
-					path.pop_back();
-				for(size_t c = 0; c < subs.size();c++){
-					path.push_back(subs[c]->getInfo());
-				}
-				//cout<<p[b]<<endl;
-				//cout<<endl;
-			}
-			if(p.size()>0){
-				vector<Vertex<T> *> subs = processedMap.findVertex(p[p.size()-1])->getProcessedEdge(processedMap.findVertex(origNode));
-				if(path.size()>0)
-					path.pop_back();
-				for(size_t c = 0; c < subs.size();c++){
-					path.push_back(subs[c]->getInfo());
-				}
+/*
+ * As above, leaving from start and ending at end. An empty route drives
+ * from one to the other (staying put if they are the same).
+ */
+template<class T>
+void DeliverySystem<T>::expandPath(const vector<T> &path, vector<T> &out, T start, T end){
+	out.clear();
+	out.push_back(start);
+	if(path.empty() && start == end){
+		out.push_back(end);
+		return;
+	}
+	vector<double> dist;
+	vector<int> nearest, pred;
+	T from = start;
+	for(size_t k = 0; k <= path.size(); k++){
+		T to = (k == path.size()) ? end : path[k];
+		if(!trees.appendLeg(originalMap, from, to, out)){
+			int idx = originalMap.findVertexIdx(from);
+			if(idx != -1){
+				originalMap.dijkstraShortestPath(vector<unsigned int>(1, idx), dist, nearest, pred);
+				trees.set(originalMap, from, pred, vector<int>(1, originalMap.findVertexIdx(to)));
+				trees.appendLeg(originalMap, from, to, out);
 			}
-			paths.push_back(path);
 		}
+		from = to;
+	}
+}
+
+template<class T>
+vector<vector<T>> DeliverySystem<T>::getVehiclesCompletePath(){
+	vector<vector<T>> paths(vehicles.size());
+	for(unsigned int a = 0; a < vehicles.size();a++)
+		expandPath(vehicles[a].getPath(), paths[a], getStartNode(vehicles[a]), getEndNode(vehicles[a]));
 	return paths;
 }
+
 template<class T>
 vector<Path<T>> DeliverySystem<T>::getVehiclesCompletePaths(){
 	vector<Path<T>> paths;
-
-		for(unsigned int a = 0; a < vehicles.size();a++){
-			string str = vehicles[a].getSpecialty();
-			setProcessedMap(str);
-			vector<T> p = vehicles[a].getPath();
-			vector<T> path;
-			if(p.size()>0){
-				vector<Vertex<T> *> subs = processedMap.findVertex(origNode)->getProcessedEdge(processedMap.findVertex(p[0]));
-				if(path.size()>0)
-					path.pop_back();
-				for(size_t c = 0; c < subs.size();c++){
-					path.push_back(subs[c]->getInfo());
-				}
-			}else{
-				path.push_back(origNode);
-				path.push_back(origNode);
-				paths.push_back(Path<T>(path,vehicles[a].getSpecialty()));
-				continue;
-			}
-			for(size_t b = 1; b < p.size();b++){
-				//cout<<p[b-1]<<" -> " << p[b] << "  :  ";
-				vector<Vertex<T> *> subs = processedMap.findVertex(p[b-1])->getProcessedEdge(processedMap.findVertex(p[b]));
-				if(path.size()>0)
-					path.pop_back();
-				for(size_t c = 0; c < subs.size();c++){
-					path.push_back(subs[c]->getInfo());
-				}
-				//cout<<p[b]<<endl;
-				//cout<<endl;
-			}
-			if(p.size()>0){
-				vector<Vertex<T> *> subs = processedMap.findVertex(p[p.size()-1])->getProcessedEdge(processedMap.findVertex(origNode));
-				if(path.size()>0)
-					path.pop_back();
-				for(size_t c = 0; c < subs.size();c++){
-					path.push_back(subs[c]->getInfo());
-				}
-			}
-			paths.push_back(Path<T>(path,vehicles[a].getSpecialty()));
-		}
+	vector<T> path;
+	for(unsigned int a = 0; a < vehicles.size();a++){
+		expandPath(vehicles[a].getPath(), path, getStartNode(vehicles[a]), getEndNode(vehicles[a]));
+		paths.push_back(Path<T>(path,vehicles[a].getSpecialty()));
+	}
 	return paths;
 }
 
@@ -570,26 +1691,354 @@ vector<Request<T>> DeliverySystem<T>::getInvalidRequest(string str) {
 template<class T>
 void DeliverySystem<T>::run(string str){
 
-	setProcessedMap(str);
+	MatrixStats matrix = setProcessedMap(str, processedMap, distances, trees);
+	cout<<endl;
 
 	newAlgorithm2(str);
+	stats.matrix = matrix;
+
+	cout << getInvalidReport(str) << endl;
+}
 
+template<class T>
+string DeliverySystem<T>::getInvalidReport(string str){
+	ostringstream os;
 	vector<Request<T>> v = getInvalidRequest(str);
 	for(size_t i = 0; i < v.size();i++){
-		cout<<"Request not doable from "<<v[i].getInicio()<<" to "<<v[i].getFim()<<" of type "<<v[i].getEspecialidade()<<".\n";
+		os<<"Request not doable from "<<v[i].getInicio()<<" to "<<v[i].getFim()<<" of type "<<v[i].getEspecialidade()<<".\n";
 	}
-	cout << endl;
+	return os.str();
 }
 
+/*
+ * Specialties share no vehicles or requests, so each one is solved in its own
+ * thread with its own processed map and distance matrix; originalMap is only
+ * read. Reports are printed in specialty order once all are done.
+ */
 template<class T>
 void DeliverySystem<T>::runEspecialidades(){
+	solveEspecialidades();
 	vector<string> esp = getEspecialidades();
 	for(size_t i = 0; i < esp.size();i++){
 		cout<<"\nProcessing :" << esp[i]<<endl;
-		run(esp[i]);
+		cout<<endl;
+		cout << getInvalidReport(esp[i]) << endl;
 	}
 }
 
+/*
+ * runEspecialidades without the reports. The maps of the last specialty are
+ * kept, as a sequential run would.
+ */
+template<class T>
+void DeliverySystem<T>::solveEspecialidades(){
+	vector<string> esp = getEspecialidades();
+	if(esp.empty())
+		return;
+	vector<Graph<T>> maps(esp.size());
+	vector<DistanceMatrix<T>> matrices(esp.size());
+	unsigned int cores = numThreads ? numThreads : max(thread::hardware_concurrency(), 1u);
+	unsigned int threads = max(cores / (unsigned int)esp.size(), 1u);
+	vector<PathTrees<T>> searched(esp.size());
+	vector<SolverStats> results(esp.size());
+
+	auto solve = [&](size_t i){
+		MatrixStats matrix = setProcessedMap(esp[i], maps[i], matrices[i], searched[i]);
+		results[i] = newAlgorithm2(esp[i], matrices[i], threads);
+		results[i].matrix = matrix;
+	};
+	vector<thread> workers;
+	for(size_t i = 1; i < esp.size();i++)
+		workers.push_back(thread(solve, i));
+	solve(0);
+	for(size_t i = 0; i < workers.size();i++)
+		workers[i].join();
+
+	processedMap = maps.back();
+	distances = matrices.back();
+	for(size_t i = 0; i < esp.size();i++)
+		trees.merge(searched[i]);
+	onlineDistances.clear();
+	if(online)
+		for(size_t i = 0; i < esp.size();i++)
+			onlineDistances[esp[i]] = std::move(matrices[i]);
+	stats = SolverStats();
+	for(size_t i = 0; i < results.size();i++)
+		stats += results[i];
+}
+
+/*
+ * Optimal routes for a specialty (see ExactSolver), under the current fleet
+ * objective. A specialty with more than EXACT_MAX_REQUESTS valid requests,
+ * with loads, windows or capacities, or with vehicles away from the origin,
+ * is left to newAlgorithm2 and its stats are not optimal; so is one whose
+ * budget ran out before any routes serving every request were found.
+ */
+template<class T>
+ExactStats DeliverySystem<T>::solveExact(string str, const DistanceMatrix<T> &matrix, double maxMillis){
+	ExactStats result;
+	vector<Vehicle<T>*> currentVehicles = getVehicles(str);
+	for(unsigned int a = 0; a < currentVehicles.size();a++)
+		currentVehicles.at(a)->reset();
+	if(currentVehicles.size() == 0)
+		return result;
+
+	vector<Request<T>> currentRequests = getValidRequest(str);
+	bool constrained = false;
+	for(unsigned int r = 0; r < currentRequests.size(); r++)
+		if(!getConstraint(currentRequests[r]).unconstrained())
+			constrained = true;
+	for(unsigned int b = 0; b < currentVehicles.size(); b++)
+		if(currentVehicles[b]->getCapacity() != INF)
+			constrained = true;
+	vector<RouteEnds> ends = getRouteEnds(matrix, currentVehicles);
+	for(unsigned int b = 0; b < ends.size(); b++)
+		if(!(ends[b] == RouteEnds()))
+			constrained = true;
+	for(const RouteProfile &p : getRouteProfiles(currentVehicles))
+		if(!p.plain())
+			constrained = true;
+
+	auto objective = [this](const FleetCost &f){
+		return (this->*calculateVehiclesPtr)(f, 0, f.getCost(0), false);
+	};
+	auto heuristic = [&](){
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		newAlgorithm2(str, matrix, numThreads);
+		FleetCost fleet;
+		fleet.reset(currentVehicles.size());
+		for(unsigned int b = 0; b < currentVehicles.size();b++)
+			fleet.update(b, currentVehicles[b]->getRouteCost());
+		result.requests = currentRequests.size();
+		result.optimal = false;
+		result.cost = objective(fleet);
+		result.millis += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		return result;
+	};
+	if(constrained || currentRequests.size() > EXACT_MAX_REQUESTS)
+		return heuristic();
+
+	ExactSolver<T> solver(matrix, objective);
+	for(unsigned int r = 0; r < currentRequests.size(); r++)
+		solver.addRequest(matrix.getSlot(currentRequests[r].getInicio()), matrix.getSlot(currentRequests[r].getFim()));
+	vector<vector<unsigned int>> routes(currentVehicles.size());
+	vector<int> owner;
+	ThreadPool pool(numThreads);
+	result = solver.run(routes, owner, pool, maxMillis);
+	if(find(owner.begin(), owner.end(), -1) != owner.end())
+		return heuristic();
+
+	for(unsigned int b = 0; b < routes.size();b++){
+		currentVehicles.at(b)->setPath(matrix.toNodes(routes[b]));
+		currentVehicles.at(b)->setRouteCost(calculatePathWeight(matrix, routes[b]));
+		currentVehicles.at(b)->setRouteLength(calculatePathWeight(matrix, routes[b]));
+	}
+	for(unsigned int r = 0, i = 0; i < requests.size(); i++)
+		if(requests[i].getEspecialidade() == str){
+			requests[i].setVehicle(-1);
+			if(!requests[i].isValid())
+				continue;
+			if(owner[r] != -1)
+				requests[i].setVehicle(currentVehicles[owner[r]] - &vehicles[0]);
+			r++;
+		}
+	return result;
+}
+
+/*
+ * Like runEspecialidades, but every specialty is solved to optimality, one
+ * after the other with all the threads, as a benchmark for the heuristic:
+ * small instances only (see solveExact). maxMillis bounds each specialty's
+ * search (0: no limit); once it runs out the best routes found are kept,
+ * or newAlgorithm2's if none were found yet.
+ * The objective of the routes, summed over specialties, is in
+ * getExactStats().
+ */
+template<class T>
+void DeliverySystem<T>::runExact(double maxMillis){
+	exactStats = ExactStats();
+	vector<string> esp = getEspecialidades();
+	for(size_t i = 0; i < esp.size();i++){
+		setProcessedMap(esp[i], processedMap, distances, trees);
+		exactStats += solveExact(esp[i], distances, maxMillis);
+		cout<<"\nProcessing :" << esp[i]<<endl;
+		cout<<endl;
+		cout << getInvalidReport(esp[i]) << endl;
+	}
+}
+
+/*
+ * Gives slots to the nodes that have none yet and fills in only their rows
+ * and columns: one search from each new node for its row and one backwards
+ * for its column.
+ */
+template<class T>
+void DeliverySystem<T>::extendDistances(DistanceMatrix<T> &matrix, const vector<T> &nodes){
+	vector<unsigned int> added;
+	for(size_t i = 0; i < nodes.size();i++)
+		if(matrix.getSlot(nodes[i]) == -1)
+			added.push_back(matrix.addSlot(nodes[i]));
+	if(added.empty())
+		return;
+	matrix.extend();
+
+	vector<int> index(matrix.size());
+	for(unsigned int j = 0; j < matrix.size();j++)
+		index[j] = originalMap.findVertexIdx(matrix.getNode(j));
+	vector<double> dist;
+	vector<int> nearest, pred;
+	for(unsigned int s : added){
+		if(index[s] == -1)
+			continue;
+		for(int backwards = 0; backwards < 2; backwards++){
+			originalMap.dijkstraShortestPath(vector<unsigned int>(1, index[s]), dist, nearest, pred, backwards);
+			for(unsigned int j = 0; j < matrix.size();j++){
+				if(index[j] == -1 || j == s)
+					continue;
+				if(backwards)
+					matrix.set(j, s, dist[index[j]]);
+				else
+					matrix.set(s, j, dist[index[j]]);
+			}
+			if(!backwards)
+				trees.set(originalMap, matrix.getNode(s), pred, index);
+		}
+	}
+}
+
+/*
+ * Inserts request i into the current routes of its specialty, as one more
+ * step of the input-order insertion, growing the distance matrix of the
+ * specialty only by the request's new interest points. The local search is
+ * then run on the specialty within the repair budget, if any. As in
+ * setProcessedMap, a request that no vehicle can reach from its depots and
+ * get back from is marked invalid, and so is one that no vehicle can take
+ * within its load and time windows. The loads and windows of each route are
+ * those of the requests the last run or dispatch gave it (see
+ * Request::getVehicle()).
+ */
+template<class T>
+DispatchReport DeliverySystem<T>::dispatch(size_t i){
+	typedef chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	DispatchReport report;
+
+	string str = requests[i].getEspecialidade();
+	requests[i].setVehicle(-1);
+	DistanceMatrix<T> &matrix = onlineDistances[str];
+	if(matrix.size() == 0){
+		matrix.addSlot(origNode);
+		matrix.allocate();
+	}
+	extendDistances(matrix, getDepots(str));
+	unsigned int before = matrix.size();
+	extendDistances(matrix, vector<T>{requests[i].getInicio(), requests[i].getFim()});
+	report.newSlots = matrix.size() - before;
+	unsigned int pickup = matrix.getSlot(requests[i].getInicio());
+	unsigned int delivery = matrix.getSlot(requests[i].getFim());
+	vector<Vehicle<T>*> currentVehicles = getVehicles(str);
+	vector<RouteEnds> ends = getRouteEnds(matrix, currentVehicles);
+	requests[i].setValid(isServable(matrix, ends, pickup, delivery));
+	Clock::time_point matrixDone = Clock::now();
+	report.matrixMillis = chrono::duration<double, milli>(matrixDone - start).count();
+
+	if(!requests[i].isValid() || currentVehicles.empty()){
+		report.millis = report.matrixMillis;
+		return report;
+	}
+
+	vector<vector<unsigned int>> routes(currentVehicles.size());
+	FleetCost fleet;
+	fleet.reset(routes.size());
+	for(unsigned int b = 0; b < routes.size();b++){
+		routes[b] = matrix.toSlots(currentVehicles[b]->getPath());
+		fleet.update(b, currentVehicles[b]->getRouteCost());
+	}
+
+	vector<unsigned int> index;	// in vehicles
+	vector<int> route(vehicles.size(), -1);
+	for(unsigned int b = 0; b < currentVehicles.size(); b++){
+		index.push_back(currentVehicles[b] - &vehicles[0]);
+		route[index[b]] = b;
+	}
+
+	//the valid requests of the specialty, as newAlgorithm2 sees them, i is
+	//r; and the route serving each, -1 for r until it is inserted and for
+	//requests no route serves
+	vector<pair<unsigned int, unsigned int>> slots;
+	vector<RequestConstraint> constraints;
+	vector<size_t> position;	// in requests
+	vector<int> owner;
+	size_t r = 0;
+	for(size_t a = 0; a < requests.size();a++)
+		if(requests[a].getEspecialidade() == str && requests[a].isValid()){
+			if(a == i)
+				r = slots.size();
+			slots.push_back(make_pair(matrix.getSlot(requests[a].getInicio()), matrix.getSlot(requests[a].getFim())));
+			constraints.push_back(getConstraint(requests[a]));
+			position.push_back(a);
+			owner.push_back(requests[a].getVehicle() == -1 ? -1 : route[requests[a].getVehicle()]);
+		}
+	vector<double> capacity(currentVehicles.size());
+	for(unsigned int b = 0; b < currentVehicles.size(); b++)
+		capacity[b] = currentVehicles[b]->getCapacity();
+	vector<RouteProfile> profiles = getRouteProfiles(currentVehicles);
+	FleetSchedule<T> schedule(matrix, slots, constraints, capacity, ends, profiles);
+	schedule.reset(routes, owner);
+
+	vector<double> cost(routes.size());
+	vector<double> v_dist(routes.size());
+	vector<vector<unsigned int>> candidate(routes.size());
+	ThreadPool pool(1);
+	vector<bool> allowed;
+	assignDepots(matrix, ends, vector<pair<unsigned int, unsigned int>>(1, make_pair(pickup, delivery))).candidates(0, allowed);
+	scoreVehicles(matrix, routes, fleet, schedule, allowed, pickup, delivery, r, cost, v_dist, candidate, pool, report.insertion);
+	unsigned int min_vehicle = selectVehicle(fleet, cost, v_dist);
+	if(min_vehicle >= routes.size() && !allowed.empty()){
+		allowed.clear();
+		scoreVehicles(matrix, routes, fleet, schedule, allowed, pickup, delivery, r, cost, v_dist, candidate, pool, report.insertion);
+		min_vehicle = selectVehicle(fleet, cost, v_dist);
+	}
+	if(min_vehicle >= routes.size()){
+		requests[i].setValid(false);
+		report.millis = chrono::duration<double, milli>(Clock::now() - start).count();
+		return report;
+	}
+	report.served = true;
+	report.vehicle = min_vehicle;
+	report.addedCost = cost[min_vehicle] - fleet.getCost(min_vehicle);
+	routes[min_vehicle].swap(candidate[min_vehicle]);
+	fleet.update(min_vehicle, cost[min_vehicle]);
+	owner[r] = min_vehicle;
+	requests[i].setVehicle(index[min_vehicle]);
+	Clock::time_point insertDone = Clock::now();
+	report.insertMillis = chrono::duration<double, milli>(insertDone - matrixDone).count();
+
+	if(repairMaxMoves > 0){
+		auto objective = [this](const FleetCost &f){
+			return (this->*calculateVehiclesPtr)(f, 0, f.getCost(0), false);
+		};
+		LocalSearch<T> search(matrix, routes, fleet, objective);
+		for(size_t a = 0; a < slots.size();a++)
+			search.addRequest(slots[a].first, slots[a].second, owner[a], constraints[a]);
+		search.setCapacities(capacity);
+		search.setEnds(ends);
+		search.setProfiles(profiles);
+		report.repair = search.run(repairMaxMoves, repairMaxMillis);
+		for(size_t a = 0; a < slots.size();a++)
+			if(search.getRoute(a) != -1)
+				requests[position[a]].setVehicle(index[search.getRoute(a)]);
+	}
+
+	for(unsigned int b = 0; b < routes.size();b++){
+		currentVehicles.at(b)->setPath(matrix.toNodes(routes[b]));
+		currentVehicles.at(b)->setRouteCost(fleet.getCost(b));
+		currentVehicles.at(b)->setRouteLength(calculatePathWeight(matrix, routes[b], ends[b]));
+	}
+	report.millis = chrono::duration<double, milli>(Clock::now() - start).count();
+	return report;
+}
+
 template<class T>
 void DeliverySystem<T>::addVehicle(Vehicle<T> vehicle) {
 	this->vehicles.push_back(vehicle);
@@ -609,4 +2058,138 @@ void DeliverySystem<T>::setRunByTime(){
 	calculateVehiclesPtr = &DeliverySystem<T>::calculateVehiclesWeight_time;
 }
 
+/*
+ * Requests are inserted in input order, each into the vehicle where it costs
+ * least (the default).
+ */
+template<class T>
+void DeliverySystem<T>::setInsertionByOrder(){
+	regretK = 0;
+}
+
+/*
+ * Requests are inserted by regret-k: the request whose best insertion would
+ * cost the most if deferred, as the sum of the differences between its k
+ * cheapest vehicles and its cheapest one, goes first. k < 2 is input order.
+ */
+template<class T>
+void DeliverySystem<T>::setInsertionByRegret(unsigned int k){
+	regretK = k;
+}
+
+/*
+ * With vehicles at several depots, whether each request is first offered
+ * only to the vehicles of its closest depots, which shrinks the candidates
+ * the insertion scores; the improvement phases may still move it to any
+ * vehicle. Off by default: with few vehicles per depot the greedy routes
+ * get much longer.
+ */
+template<class T>
+void DeliverySystem<T>::setNearestDepot(bool on){
+	nearestDepot = on;
+}
+
+/*
+ * With a large fleet, the requests of a specialty can first be split into k
+ * groups, each given a share of the vehicles, and every group then inserted
+ * and improved on its own, in parallel (see clusterRequests). Each request
+ * is then only scored in the vehicles of its group, and the local search
+ * only moves it within them, so runs are faster but routes get longer; the
+ * improvement budgets are shared out among the groups.
+ * By sweep the groups are sectors around the origin; by k-means, requests
+ * with pickups and deliveries close together. k < 2 turns it off (the
+ * default), as does a vertex without coordinates.
+ */
+template<class T>
+void DeliverySystem<T>::setClustersBySweep(unsigned int k){
+	clusterCount = k;
+	clusterByKMeans = false;
+}
+
+template<class T>
+void DeliverySystem<T>::setClustersByKMeans(unsigned int k){
+	clusterCount = k;
+	clusterByKMeans = true;
+}
+
+/*
+ * Threads used to score vehicles in newAlgorithm2 (0: one per core, 1: serial).
+ */
+template<class T>
+void DeliverySystem<T>::setNumThreads(unsigned int n){
+	numThreads = n;
+}
+
+/*
+ * Budget of the local search run after the greedy insertion, per specialty:
+ * at most maxMoves improving moves and maxMillis milliseconds (0: no time
+ * limit, the default). maxMoves = 0 turns the local search off. A time
+ * limit makes the routes depend on the speed and load of the machine.
+ */
+template<class T>
+void DeliverySystem<T>::setLocalSearch(unsigned int maxMoves, double maxMillis){
+	lsMaxMoves = maxMoves;
+	lsMaxMillis = maxMillis;
+}
+
+/*
+ * Ruin and recreate run between the greedy insertion and the local search,
+ * with one search per thread, for at most maxIterations iterations per
+ * search and maxMillis milliseconds (0: no limit; both 0 turns it off).
+ * Runs are reproducible for a given seed with an iteration budget and a
+ * single thread (setNumThreads(1)).
+ */
+template<class T>
+void DeliverySystem<T>::setLNS(unsigned long maxIterations, double maxMillis, unsigned int seed){
+	lnsMaxIterations = maxIterations;
+	lnsMaxMillis = maxMillis;
+	lnsSeed = seed;
+}
+
+/*
+ * Counters of the last run (summed over specialties).
+ */
+template<class T>
+MatrixStats DeliverySystem<T>::getMatrixStats() const{return stats.matrix;}
+
+template<class T>
+InsertionStats DeliverySystem<T>::getInsertionStats() const{return stats.insertion;}
+
+template<class T>
+LocalSearchStats DeliverySystem<T>::getLocalSearchStats() const{return stats.localSearch;}
+
+template<class T>
+LNSStats DeliverySystem<T>::getLNSStats() const{return stats.lns;}
+
+template<class T>
+ClusterStats DeliverySystem<T>::getClusterStats() const{return stats.clusters;}
+
+/*
+ * Counters of the last runExact().
+ */
+template<class T>
+ExactStats DeliverySystem<T>::getExactStats() const{return exactStats;}
+
+/*
+ * While online, every request added after runEspecialidades() is inserted
+ * into the current routes straight away (see dispatch()) instead of waiting
+ * for the next run, followed by a local search of at most repairMoves moves
+ * and repairMillis milliseconds (0 moves: none). A run starts over from all
+ * the requests, as before.
+ */
+template<class T>
+void DeliverySystem<T>::setOnline(bool on, unsigned int repairMoves, double repairMillis){
+	online = on;
+	repairMaxMoves = repairMoves;
+	repairMaxMillis = repairMillis;
+	if(!on)
+		onlineDistances.clear();
+}
+
+/*
+ * One report per request added while online, in order.
+ */
+template<class T>
+vector<DispatchReport> DeliverySystem<T>::getDispatchReports() const{return dispatches;}
+
 #endif
@@ -0,0 +1,208 @@
+/*
+ * DistanceMatrix.h
+ *
+ * Shortest distances between the interest points of a DeliverySystem
+ * (depots, pickups and deliveries). Every distinct node gets a slot and the
+ * distances are kept in one contiguous row-major array, so the distance
+ * between two slots is a single array load. Slots can be added after the
+ * matrix is allocated (see extend()), so rows keep some spare room.
+ */
+
+#ifndef SRC_DISTANCEMATRIX_H_
+#define SRC_DISTANCEMATRIX_H_
+
+#include "Graph.h"
+
+/*
+ * Slots a route leaves from and returns to: the origin (slot 0) unless its
+ * vehicle has depots of its own.
+ */
+struct RouteEnds{
+	unsigned int start = 0, end = 0;
+
+	bool operator==(const RouteEnds &e) const{
+		return start == e.start && end == e.end;
+	}
+};
+
+template<class T>
+class DistanceMatrix{
+
+	vector<T> nodes;						// slot -> node
+	unordered_map<T, unsigned int> slots;	// node -> slot
+	vector<double> dist;					// row-major, size() x stride
+	unsigned int n = 0;
+	unsigned int stride = 0;				// row length, >= n
+
+public:
+	void clear();
+	unsigned int addSlot(T node);
+	void allocate();
+	void extend();
+
+	int getSlot(T node) const;
+	T getNode(unsigned int slot) const;
+	unsigned int size() const;
+	vector<unsigned int> toSlots(const vector<T> &path) const;
+	vector<T> toNodes(const vector<unsigned int> &route) const;
+
+	double get(unsigned int from, unsigned int to) const;
+	void set(unsigned int from, unsigned int to, double d);
+
+	double cheapestInsertion(const vector<unsigned int> &route, unsigned int pickup, unsigned int delivery, size_t &bestA, size_t &bestI,
+			const RouteEnds &ends = RouteEnds()) const;
+};
+
+/*
+ * Distances of a matrix times a factor, read through without copying it:
+ * e.g. the travel times of a vehicle faster or slower than the distances.
+ */
+template<class T>
+class ScaledMatrix{
+
+	const DistanceMatrix<T> &d;
+	double factor;
+
+public:
+	ScaledMatrix(const DistanceMatrix<T> &d, double factor) : d(d), factor(factor){}
+
+	double get(unsigned int from, unsigned int to) const{return d.get(from, to) * factor;}
+};
+
+template<class T>
+void DistanceMatrix<T>::clear(){
+	nodes.clear();
+	slots.clear();
+	dist.clear();
+	n = 0;
+	stride = 0;
+}
+
+/*
+ * Returns the slot of the node, creating it if needed. Slots added after
+ * allocate() only get distances once extend() is called.
+ */
+template<class T>
+unsigned int DistanceMatrix<T>::addSlot(T node){
+	auto it = slots.find(node);
+	if(it != slots.end())
+		return it->second;
+	slots.insert(make_pair(node, nodes.size()));
+	nodes.push_back(node);
+	return nodes.size() - 1;
+}
+
+/*
+ * Sets every distance to INF, except from a slot to itself.
+ */
+template<class T>
+void DistanceMatrix<T>::allocate(){
+	n = stride = nodes.size();
+	dist.assign(n * n, INF);
+	for(unsigned int i = 0; i < n; i++)
+		dist[i * n + i] = 0;
+}
+
+/*
+ * Makes room for the slots added since the last allocate() or extend(),
+ * keeping every distance already set. The new rows and columns are INF,
+ * except from a slot to itself. Rows grow by half when full, so adding
+ * slots one at a time costs amortised O(size()) each.
+ */
+template<class T>
+void DistanceMatrix<T>::extend(){
+	unsigned int m = nodes.size();
+	if(m > stride){
+		unsigned int s = std::max(m, stride + stride / 2);
+		vector<double> grown(m * s, INF);
+		for(unsigned int i = 0; i < n; i++)
+			copy(dist.begin() + i * stride, dist.begin() + i * stride + n, grown.begin() + i * s);
+		dist.swap(grown);
+		stride = s;
+	}else{
+		dist.resize(m * stride, INF);
+		for(unsigned int i = 0; i < n; i++)
+			fill(dist.begin() + i * stride + n, dist.begin() + i * stride + m, INF);
+	}
+	for(unsigned int i = n; i < m; i++)
+		dist[i * stride + i] = 0;
+	n = m;
+}
+
+template<class T>
+int DistanceMatrix<T>::getSlot(T node) const{
+	auto it = slots.find(node);
+	if(it == slots.end())
+		return -1;
+	return it->second;
+}
+
+template<class T>
+T DistanceMatrix<T>::getNode(unsigned int slot) const{return nodes[slot];}
+
+template<class T>
+unsigned int DistanceMatrix<T>::size() const{return n;}
+
+template<class T>
+vector<unsigned int> DistanceMatrix<T>::toSlots(const vector<T> &path) const{
+	vector<unsigned int> route(path.size());
+	for(size_t i = 0; i < path.size(); i++)
+		route[i] = getSlot(path[i]);
+	return route;
+}
+
+template<class T>
+vector<T> DistanceMatrix<T>::toNodes(const vector<unsigned int> &route) const{
+	vector<T> path(route.size());
+	for(size_t i = 0; i < route.size(); i++)
+		path[i] = nodes[route[i]];
+	return path;
+}
+
+template<class T>
+inline double DistanceMatrix<T>::get(unsigned int from, unsigned int to) const{
+	return dist[from * stride + to];
+}
+
+template<class T>
+inline void DistanceMatrix<T>::set(unsigned int from, unsigned int to, double d){
+	dist[from * stride + to] = d;
+}
+
+/*
+ * Cheapest place for a request in a route (slots, leaving from and returning
+ * to the given ends), as the added length: the pickup goes before stop
+ * bestA and the delivery before stop bestI (route.size(): at the end),
+ * bestA <= bestI. Each of the O(L^2) candidates is scored in O(1).
+ */
+template<class T>
+double DistanceMatrix<T>::cheapestInsertion(const vector<unsigned int> &route, unsigned int pickup, unsigned int delivery, size_t &bestA, size_t &bestI,
+		const RouteEnds &ends) const{
+	size_t L = route.size();
+	double best = INF;
+	for(size_t a = 0; a <= L; a++){
+		unsigned int prev = (a == 0) ? ends.start : route[a - 1];
+		unsigned int to = (a == L) ? ends.end : route[a];
+		double cp = get(prev, pickup) + get(pickup, to) - get(prev, to);
+		if(cp >= best)
+			continue;
+		for(size_t i = a; i <= L; i++){
+			double c;
+			if(i == a)
+				c = cp + get(pickup, delivery) + get(delivery, to) - get(pickup, to);
+			else{
+				unsigned int from = route[i - 1];
+				unsigned int next = (i == L) ? ends.end : route[i];
+				c = cp + get(from, delivery) + get(delivery, next) - get(from, next);
+			}
+			if(c < best){
+				best = c;
+				bestA = a;
+				bestI = i;
+			}
+		}
+	}
+	return best;
+}
+
+#endif /* SRC_DISTANCEMATRIX_H_ */
@@ -0,0 +1,380 @@
+/*
+ * ExactSolver.h
+ *
+ * Optimal routes for small instances, as a yardstick for the heuristics.
+ * A dynamic programme over the state of every request (waiting, on board or
+ * delivered) and the last stop visited gives the shortest single route
+ * serving each subset of the requests, pickups before deliveries. A branch
+ * and bound then splits the requests among the vehicles, one subset per
+ * route, bounded below by the objective of the routes chosen so far plus
+ * the cheapest split of the rest over the vehicles left. The top level
+ * branches (the subsets holding the first request) are searched in
+ * parallel, sharing the best objective found through an atomic slot.
+ *
+ * The programme has 3^n * n entries for n requests, so n is capped at
+ * EXACT_MAX_REQUESTS. Vehicles are taken as alike, and loads, capacities
+ * and time windows are not modelled.
+ */
+
+#ifndef SRC_EXACTSOLVER_H_
+#define SRC_EXACTSOLVER_H_
+
+#include <chrono>
+#include <atomic>
+#include <functional>
+
+#include "DistanceMatrix.h"
+#include "FleetCost.h"
+#include "ThreadPool.h"
+
+#define EXACT_MAX_REQUESTS 12
+#define EXACT_EPSILON 1e-9		// relative slack of the bounds, for rounding
+
+struct ExactStats{
+	unsigned int requests = 0;
+	unsigned long states = 0;				// entries of the programme reached
+	unsigned long nodes = 0, pruned = 0;	// of the branch and bound
+	bool optimal = true;	// false once a budget ran out or an instance was left to the heuristic
+	double cost = 0;		// objective of the routes returned
+	double millis = 0;
+
+	ExactStats & operator+=(const ExactStats &s){
+		requests += s.requests;
+		states += s.states;
+		nodes += s.nodes;
+		pruned += s.pruned;
+		optimal = optimal && s.optimal;
+		cost += s.cost;
+		millis += s.millis;
+		return *this;
+	}
+};
+
+template<class T>
+class ExactSolver{
+
+	typedef chrono::steady_clock Clock;
+
+	struct Best{
+		double cost = INF;
+		vector<unsigned int> parts;	// subset served by each route
+	};
+
+	const DistanceMatrix<T> &d;
+	function<double(const FleetCost &)> objective;
+	vector<pair<unsigned int, unsigned int>> requests;	// pickup and delivery slots
+
+	unsigned int n = 0;
+	vector<unsigned long> power;			// 3^r
+	vector<double> walk;					// [state * n + r]: shortest walk from the origin to state, ending at r's last stop
+	vector<double> subsetCost;				// [mask]: shortest route serving the requests of mask
+	vector<vector<double>> split;			// [k][mask]: cheapest total length serving mask with at most k routes
+
+	atomic<double> bestCost;
+	atomic<bool> expired;
+	Clock::time_point start;
+	double maxMillis = 0;
+
+	unsigned int digit(unsigned long state, unsigned int r) const;
+	unsigned int stop(unsigned long state, unsigned int r) const;
+	unsigned long delivered(unsigned int mask) const;
+	bool outOfTime();
+	void solveRoutes(ExactStats &stats);
+	void solveSplits(unsigned int routes);
+	vector<unsigned int> route(unsigned int mask) const;
+	void branch(unsigned int mask, unsigned int used, unsigned int routes, FleetCost &fleet, vector<unsigned int> &parts, Best &best, ExactStats &stats);
+
+public:
+	ExactSolver(const DistanceMatrix<T> &d, function<double(const FleetCost &)> objective);
+
+	void addRequest(unsigned int pickup, unsigned int delivery);
+	ExactStats run(vector<vector<unsigned int>> &routes, vector<int> &owner, ThreadPool &pool, double maxMillis);
+};
+
+template<class T>
+ExactSolver<T>::ExactSolver(const DistanceMatrix<T> &d, function<double(const FleetCost &)> objective)
+	: d(d), objective(objective), bestCost(INF), expired(false){}
+
+template<class T>
+void ExactSolver<T>::addRequest(unsigned int pickup, unsigned int delivery){
+	requests.push_back(make_pair(pickup, delivery));
+}
+
+/*
+ * 0: waiting, 1: on board, 2: delivered.
+ */
+template<class T>
+inline unsigned int ExactSolver<T>::digit(unsigned long state, unsigned int r) const{
+	return (state / power[r]) % 3;
+}
+
+/*
+ * Slot of the last stop made for r: its pickup while on board, else its
+ * delivery.
+ */
+template<class T>
+inline unsigned int ExactSolver<T>::stop(unsigned long state, unsigned int r) const{
+	return digit(state, r) == 1 ? requests[r].first : requests[r].second;
+}
+
+template<class T>
+inline unsigned long ExactSolver<T>::delivered(unsigned int mask) const{
+	unsigned long state = 0;
+	for(unsigned int r = 0; r < n; r++)
+		if(mask & (1u << r))
+			state += 2 * power[r];
+	return state;
+}
+
+/*
+ * Checks the clock now and then; true once the budget is spent.
+ */
+template<class T>
+bool ExactSolver<T>::outOfTime(){
+	if(maxMillis > 0 && chrono::duration<double, milli>(Clock::now() - start).count() > maxMillis)
+		expired = true;
+	return expired;
+}
+
+/*
+ * Every step moves one request on (waiting to on board to delivered), which
+ * raises the state, so states are final once reached in increasing order.
+ */
+template<class T>
+void ExactSolver<T>::solveRoutes(ExactStats &stats){
+	unsigned long states = power[n];
+	walk.assign(states * n, INF);
+	for(unsigned int r = 0; r < n; r++)
+		walk[power[r] * n + r] = d.get(0, requests[r].first);
+
+	for(unsigned long state = 1; state < states; state++){
+		if((state & 4095) == 0 && outOfTime())
+			return;
+		for(unsigned int r = 0; r < n; r++){
+			double length = walk[state * n + r];
+			if(length >= INF)
+				continue;
+			stats.states++;
+			unsigned int from = stop(state, r);
+			for(unsigned int q = 0; q < n; q++){
+				unsigned int k = digit(state, q);
+				if(k == 2)
+					continue;
+				unsigned int to = (k == 0) ? requests[q].first : requests[q].second;
+				double next = length + d.get(from, to);
+				double &entry = walk[(state + power[q]) * n + q];
+				if(next < entry)
+					entry = next;
+			}
+		}
+	}
+
+	subsetCost.assign(1u << n, INF);
+	subsetCost[0] = 0;
+	for(unsigned int mask = 1; mask < (1u << n); mask++){
+		unsigned long state = delivered(mask);
+		for(unsigned int r = 0; r < n; r++)
+			if((mask & (1u << r)) && walk[state * n + r] < INF)
+				subsetCost[mask] = std::min(subsetCost[mask], walk[state * n + r] + d.get(requests[r].second, 0));
+	}
+}
+
+/*
+ * The subset holding the lowest request of mask goes in one route, the rest
+ * in at most k - 1 others.
+ */
+template<class T>
+void ExactSolver<T>::solveSplits(unsigned int routes){
+	unsigned int full = (1u << n) - 1;
+	split.assign(routes + 1, vector<double>(1u << n, INF));
+	split[0][0] = 0;
+	for(unsigned int k = 1; k <= routes; k++){
+		split[k][0] = 0;
+		for(unsigned int mask = 1; mask <= full; mask++){
+			double best = split[k - 1][mask];
+			unsigned int low = mask & (~mask + 1);
+			unsigned int rest = mask ^ low;
+			for(unsigned int sub = rest; ; sub = (sub - 1) & rest){
+				unsigned int part = sub | low;
+				if(subsetCost[part] < INF && split[k - 1][mask ^ part] < INF)
+					best = std::min(best, subsetCost[part] + split[k - 1][mask ^ part]);
+				if(sub == 0)
+					break;
+			}
+			split[k][mask] = best;
+		}
+	}
+}
+
+/*
+ * Stops of the shortest route serving mask, walked back from its last stop
+ * by finding, at every step, the entry that produced the current one.
+ */
+template<class T>
+vector<unsigned int> ExactSolver<T>::route(unsigned int mask) const{
+	vector<unsigned int> stops;
+	if(mask == 0)
+		return stops;
+	unsigned long state = delivered(mask);
+	unsigned int r = n;
+	for(unsigned int q = 0; q < n; q++)
+		if((mask & (1u << q)) && walk[state * n + q] < INF
+				&& walk[state * n + q] + d.get(requests[q].second, 0) == subsetCost[mask]){
+			r = q;
+			break;
+		}
+	while(true){
+		unsigned int at = stop(state, r);
+		stops.push_back(at);
+		double length = walk[state * n + r];
+		unsigned long prev = state - power[r];
+		if(prev == 0)
+			break;
+		for(unsigned int q = 0; q < n; q++){
+			if(digit(prev, q) == 0 || walk[prev * n + q] >= INF)
+				continue;
+			if(walk[prev * n + q] + d.get(stop(prev, q), at) == length){
+				r = q;
+				break;
+			}
+		}
+		state = prev;
+	}
+	reverse(stops.begin(), stops.end());
+	//back to back stops at one slot cost nothing, keep one
+	stops.erase(unique(stops.begin(), stops.end()), stops.end());
+	return stops;
+}
+
+/*
+ * Routes 0 .. used - 1 hold parts; mask is left for routes used .. routes - 1.
+ */
+template<class T>
+void ExactSolver<T>::branch(unsigned int mask, unsigned int used, unsigned int routes, FleetCost &fleet, vector<unsigned int> &parts, Best &best, ExactStats &stats){
+	stats.nodes++;
+	if((stats.nodes & 1023) == 0 && outOfTime())
+		return;
+	if(expired)
+		return;
+	double bound = objective(fleet) + split[routes - used][mask];
+	double limit = std::min(best.cost, bestCost.load());
+	if(split[routes - used][mask] >= INF || bound > limit + EXACT_EPSILON * (1 + limit)){
+		stats.pruned++;
+		return;
+	}
+	if(mask == 0){
+		double cost = objective(fleet);
+		if(cost < best.cost){
+			best.cost = cost;
+			best.parts = parts;
+			double shared = bestCost.load();
+			while(cost < shared && !bestCost.compare_exchange_weak(shared, cost));
+		}
+		return;
+	}
+
+	//most promising subsets first
+	vector<pair<double, unsigned int>> children;
+	unsigned int low = mask & (~mask + 1);
+	unsigned int rest = mask ^ low;
+	for(unsigned int sub = rest; ; sub = (sub - 1) & rest){
+		unsigned int part = sub | low;
+		if(subsetCost[part] < INF && split[routes - used - 1][mask ^ part] < INF)
+			children.push_back(make_pair(subsetCost[part] + split[routes - used - 1][mask ^ part], part));
+		if(sub == 0)
+			break;
+	}
+	stable_sort(children.begin(), children.end(),
+			[](const pair<double, unsigned int> &x, const pair<double, unsigned int> &y){return x.first < y.first;});
+	for(auto &child : children){
+		fleet.update(used, subsetCost[child.second]);
+		parts.push_back(child.second);
+		branch(mask ^ child.second, used + 1, routes, fleet, parts, best, stats);
+		parts.pop_back();
+		fleet.update(used, 0);
+	}
+}
+
+/*
+ * Fills routes (one per vehicle, given as empty) with optimal ones, and
+ * owner with the route of every request. The objective must grow at least
+ * as fast as the length of any one route, as both fleet objectives do, for
+ * the bound to hold. With maxMillis (0: no limit) spent, the best routes
+ * found so far are returned, not optimal; if none was found, the routes
+ * are left empty and every owner -1.
+ */
+template<class T>
+ExactStats ExactSolver<T>::run(vector<vector<unsigned int>> &routes, vector<int> &owner, ThreadPool &pool, double maxMillis){
+	ExactStats total;
+	start = Clock::now();
+	this->maxMillis = maxMillis;
+	n = requests.size();
+	total.requests = n;
+	for(auto &route : routes)
+		route.clear();
+	owner.assign(n, -1);
+	if(n == 0 || routes.empty() || n > EXACT_MAX_REQUESTS){
+		total.optimal = n == 0;
+		return total;
+	}
+	power.assign(n + 1, 1);
+	for(unsigned int r = 1; r <= n; r++)
+		power[r] = power[r - 1] * 3;
+
+	expired = false;
+	solveRoutes(total);
+	if(expired){
+		total.optimal = false;
+		total.millis = chrono::duration<double, milli>(Clock::now() - start).count();
+		return total;
+	}
+	unsigned int used = std::min<size_t>(routes.size(), n);
+	solveSplits(used);
+
+	//the top level: every subset with request 0 in route 0
+	unsigned int full = (1u << n) - 1;
+	vector<unsigned int> tops;
+	for(unsigned int sub = full ^ 1u; ; sub = (sub - 1) & (full ^ 1u)){
+		if(subsetCost[sub | 1u] < INF)
+			tops.push_back(sub | 1u);
+		if(sub == 0)
+			break;
+	}
+	stable_sort(tops.begin(), tops.end(), [&](unsigned int x, unsigned int y){
+		return subsetCost[x] + split[used - 1][full ^ x] < subsetCost[y] + split[used - 1][full ^ y];
+	});
+
+	bestCost = INF;
+	vector<Best> best(tops.size());
+	vector<ExactStats> stats(tops.size());
+	pool.parallelFor(tops.size(), [&](size_t i){
+		FleetCost fleet;
+		fleet.reset(routes.size());
+		fleet.update(0, subsetCost[tops[i]]);
+		vector<unsigned int> parts(1, tops[i]);
+		branch(full ^ tops[i], 1, used, fleet, parts, best[i], stats[i]);
+	});
+
+	//cheapest, first branch in order on ties
+	int winner = -1;
+	for(unsigned int i = 0; i < tops.size(); i++){
+		total.nodes += stats[i].nodes;
+		total.pruned += stats[i].pruned;
+		if(best[i].cost < INF && (winner == -1 || best[i].cost < best[winner].cost))
+			winner = i;
+	}
+	total.optimal = !expired && winner != -1;
+	if(winner != -1){
+		for(unsigned int k = 0; k < best[winner].parts.size(); k++){
+			routes[k] = route(best[winner].parts[k]);
+			for(unsigned int r = 0; r < n; r++)
+				if(best[winner].parts[k] & (1u << r))
+					owner[r] = k;
+		}
+		total.cost = best[winner].cost;
+	}
+	total.millis = chrono::duration<double, milli>(Clock::now() - start).count();
+	return total;
+}
+
+#endif /* SRC_EXACTSOLVER_H_ */
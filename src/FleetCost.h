@@ -0,0 +1,92 @@
+/*
+ * FleetCost.h
+ *
+ * Route costs of a set of vehicles, with the total kept as a running sum and
+ * the longest route in a max segment tree. Changing or trying a new cost for
+ * one vehicle never looks at the other routes.
+ */
+
+#ifndef SRC_FLEETCOST_H_
+#define SRC_FLEETCOST_H_
+
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+class FleetCost{
+
+	vector<double> tree;	// leaves at [n, 2n), node i = max(2i, 2i+1)
+	double total = 0;
+	size_t n = 0;
+
+	double getMax(size_t l, size_t r) const;
+
+public:
+	void reset(size_t numVehicles);
+	void update(size_t v, double cost);
+
+	size_t size() const;
+	double getCost(size_t v) const;
+	double getTotal() const;
+	double getTotal(size_t v, double cost) const;
+	double getMax() const;
+	double getMaxExcluding(size_t v) const;
+};
+
+inline void FleetCost::reset(size_t numVehicles){
+	n = numVehicles;
+	tree.assign(2 * n, 0);
+	total = 0;
+}
+
+inline void FleetCost::update(size_t v, double cost){
+	size_t i = v + n;
+	total += cost - tree[i];
+	tree[i] = cost;
+	for(i /= 2; i >= 1; i /= 2)
+		tree[i] = max(tree[2 * i], tree[2 * i + 1]);
+}
+
+inline size_t FleetCost::size() const{return n;}
+
+inline double FleetCost::getCost(size_t v) const{return tree[v + n];}
+
+inline double FleetCost::getTotal() const{return total;}
+
+/*
+ * Total with vehicle v costing cost, summed in vehicle order like a full
+ * rescore would (the running total may differ from it in the last bits).
+ * O(n): meant only to break ties between candidates.
+ */
+inline double FleetCost::getTotal(size_t v, double cost) const{
+	double res = 0;
+	for(size_t i = 0; i < n; i++)
+		res += (i == v) ? cost : tree[i + n];
+	return res;
+}
+
+inline double FleetCost::getMax() const{return getMax(0, n);}
+
+/*
+ * Longest route among vehicles [l, r).
+ */
+inline double FleetCost::getMax(size_t l, size_t r) const{
+	double res = 0;
+	for(l += n, r += n; l < r; l /= 2, r /= 2){
+		if(l & 1)
+			res = max(res, tree[l++]);
+		if(r & 1)
+			res = max(res, tree[--r]);
+	}
+	return res;
+}
+
+/*
+ * Longest route of every vehicle but v, in O(log n).
+ */
+inline double FleetCost::getMaxExcluding(size_t v) const{
+	return max(getMax(0, v), getMax(v + 1, n));
+}
+
+#endif /* SRC_FLEETCOST_H_ */
@@ -3,7 +3,9 @@
 
 #include "MutablePriorityQueue.h"
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <functional>
 #include <iostream>
 #include <limits>
 #include <queue>
@@ -47,6 +49,7 @@ template <class T> class Vertex {
   double dist = 0;
   Vertex<T> *path = nullptr;
   int queueIndex = 0; // required by MutablePriorityQueue
+  unsigned int index = 0; // position in Graph::vertexSet
 
   void addProcessedEdge(Vertex<T> *dest, vector<Vertex<T> *> path);
   void addEdge(Vertex<T> *dest, double w);
@@ -63,6 +66,7 @@ public:
   bool operator<(Vertex<T> &vertex) const; // // required by MutablePriorityQueue
   T getInfo() const;
   double getDist() const;
+  unsigned int getIndex() const;
   Vertex *getPath() const;
   vector<Edge<T>> getEdges() const;
   vector<Vertex<T> *> getProcessedEdge(Vertex<T> *dest);
@@ -159,13 +163,17 @@ template <class T> T Vertex<T>::getInfo() const { return this->info; }
 
 template <class T> double Vertex<T>::getDist() const { return this->dist; }
 
+template <class T> unsigned int Vertex<T>::getIndex() const {
+  return this->index;
+}
+
 template <class T> Vertex<T> *Vertex<T>::getPath() const { return this->path; }
 
 /********************** Edge  ****************************/
 
 template <class T> class Edge {
 
-  static unsigned int currentEdge;
+  static atomic<unsigned int> currentEdge; // graphs may be built concurrently
 
   double weight = 0; // edge weight
 
@@ -189,7 +197,7 @@ public:
   double getWeight() const;
 };
 
-template <class T> unsigned int Edge<T>::currentEdge = 0;
+template <class T> atomic<unsigned int> Edge<T>::currentEdge(0);
 
 template <class T>
 Edge<T>::Edge(Vertex<T> *o, Vertex<T> *d, vector<Vertex<T> *> path)
@@ -228,7 +236,7 @@ template <class T> struct hhash {
 };
 
 template <class T> class Graph {
-  // vector<Vertex<T> *> vertexSet;    // vertex set
+  vector<Vertex<T> *> vertexSet; // dense vertex set, indexed by Vertex::index
   std::unordered_set<Vertex<T> *, hhash<T>, eqhash<T>> vertexHashTable;
   // std::unordered_map< T, Vertex<T> *, hhash<T>, eqhash<T> > vertexMap;
 
@@ -237,10 +245,15 @@ template <class T> class Graph {
   bool relax(Vertex<T> *v, Vertex<T> *w, double weight);
   double **W = nullptr; // dist
   int **P = nullptr;    // path
-  int findVertexIdx(const T &in) const;
+  unsigned long stamp = nextStamp(); // of the current vertex indices
+  void indexVertex(Vertex<T> *v);
+  static unsigned long nextStamp();
 
 public:
   Vertex<T> *findVertex(const T &in) const;
+  int findVertexIdx(const T &in) const;
+  Vertex<T> *getVertex(unsigned int idx) const;
+  void reserve(unsigned int numVertex);
   bool addVertex(const T &in);
   bool addVertex(const T &in, double x, double y);
   bool removeVertex(Vertex<T> &v);
@@ -254,6 +267,7 @@ public:
   double getWeight(T orig, T dest);
   int getNumVertex() const;
   vector<Vertex<T> *> getVertexSet() const;
+  unsigned long getStamp() const;
 
   // Fp05 - single source
   void dijkstraShortestPath(const T &s);
@@ -262,6 +276,17 @@ public:
   vector<T> getPath(const T &origin, const T &dest) const;
   vector<Vertex<T> *> getPathV(const T &origin, const T &dest) const;
 
+  // Multi source (does not touch the vertices, results go to the arrays)
+  void dijkstraShortestPath(const vector<unsigned int> &sources,
+                            vector<double> &dist, vector<int> &nearest,
+                            bool reverse = false) const;
+  void dijkstraShortestPath(const vector<unsigned int> &sources,
+                            vector<double> &dist, vector<int> &nearest,
+                            vector<int> &path, bool reverse = false) const;
+  vector<Vertex<T> *> getPathV(const vector<double> &dist,
+                               const vector<int> &path,
+                               unsigned int dest) const;
+
   // Fp05 - all pairs
   void floydWarshallShortestPath();
   vector<T> getfloydWarshallPath(const T &origin, const T &dest) const;
@@ -277,12 +302,22 @@ template <class T> int Graph<T>::getNumVertex() const {
 }
 
 template <class T> vector<Vertex<T> *> Graph<T>::getVertexSet() const {
-  vector<Vertex<T> *> v;
-  for (auto it = vertexHashTable.begin(); it != vertexHashTable.end(); ++it)
-    v.push_back(*it);
-  return v;
+  return vertexSet;
 }
 
+template <class T> unsigned long Graph<T>::nextStamp() {
+  static atomic<unsigned long> last(0);
+  return ++last;
+}
+
+/*
+ * Changes whenever vertex indices are given to other vertices (see
+ * removeVertex), and differs between graphs built separately (copies share
+ * it). Indices taken while it had a value still address the same vertices
+ * while it keeps that value; adding vertices does not change it.
+ */
+template <class T> unsigned long Graph<T>::getStamp() const { return stamp; }
+
 template <class T> double Graph<T>::getWeight(T orig, T dest) {
   Vertex<T> *v = findVertex(orig);
   if (v == nullptr)
@@ -309,13 +344,40 @@ template <class T> Vertex<T> *Graph<T>::findVertex(const T &in) const {
 
 /*
  * Finds the index of the vertex with a given content.
+ * Indices are dense (0 .. getNumVertex()-1), so they can be used to address
+ * plain arrays instead of hashing the vertex contents again.
  */
 template <class T> int Graph<T>::findVertexIdx(const T &in) const {
-  /*for (unsigned i = 0; i < vertexSet.size(); i++)
-          if (vertexSet[i]->info == in)
-                  return i;*/
-  return -1;
+  Vertex<T> *v = findVertex(in);
+  if (v == nullptr)
+    return -1;
+  return v->index;
+}
+
+template <class T> Vertex<T> *Graph<T>::getVertex(unsigned int idx) const {
+  if (idx >= vertexSet.size())
+    return nullptr;
+  return vertexSet[idx];
+}
+
+/*
+ * Auxiliary function to register a new vertex in both the hash table and the
+ * dense vertex set.
+ */
+template <class T> void Graph<T>::indexVertex(Vertex<T> *v) {
+  v->index = vertexSet.size();
+  vertexSet.push_back(v);
+  vertexHashTable.insert(v);
 }
+/*
+ * Preallocates room for numVertex vertices, to avoid rehashing while a large
+ * map is being loaded.
+ */
+template <class T> void Graph<T>::reserve(unsigned int numVertex) {
+  vertexSet.reserve(numVertex);
+  vertexHashTable.reserve(numVertex);
+}
+
 /*
  *  Adds a vertex with a given content or info (in) to a graph (this).
  *  Returns true if successful, and false if a vertex with that content already
@@ -325,8 +387,7 @@ template <class T> bool Graph<T>::addVertex(const T &in) {
   if (findVertex(in) != nullptr)
     return false;
   Vertex<T> *v = new Vertex<T>(in);
-  // vertexSet.push_back(v);
-  vertexHashTable.insert(v);
+  indexVertex(v);
   return true;
 }
 
@@ -334,8 +395,7 @@ template <class T> bool Graph<T>::addVertex(const T &in, double x, double y) {
   if (findVertex(in) != nullptr)
     return false;
   Vertex<T> *v = new Vertex<T>(in, x, y);
-  // vertexSet.push_back(v);
-  vertexHashTable.insert(v);
+  indexVertex(v);
   return true;
 }
 
@@ -361,9 +421,18 @@ template <class T> bool Graph<T>::removeVertex(Vertex<T> &v) {
 }
 
 template <class T> bool Graph<T>::removeVertex(const T &content) {
-	if (findVertex(content)==nullptr)
+	Vertex<T> *v = findVertex(content);
+	if (v == nullptr)
 		return false;
-	vertexHashTable.erase(vertexHashTable.find(findVertex(content)));
+	vertexHashTable.erase(vertexHashTable.find(v));
+	// edges into it would lead to the vertex that takes its index
+	for (Vertex<T> *u : vertexSet)
+		u->edgeHashTable.erase(Edge<T>(u, v, 0.0));
+	// keep the vertex set dense: the last vertex takes the removed slot
+	vertexSet[v->index] = vertexSet.back();
+	vertexSet[v->index]->index = v->index;
+	vertexSet.pop_back();
+	stamp = nextStamp();
 	return true;
 }
 
@@ -474,6 +543,75 @@ template <class T> void Graph<T>::dijkstraShortestPath(const T &origin) {
   }
 }
 
+/*
+ * Dijkstra seeded with all the given vertices (dense indices) at distance 0.
+ * On return, for every vertex index i, dist[i] holds the distance from the
+ * closest source and nearest[i] the index of that source (-1 and INF when
+ * unreachable). With reverse set, edges are followed backwards, so dist[i] is
+ * the distance from i to its closest source instead.
+ * The vertices themselves are left untouched, so several searches may run on
+ * the same graph at once.
+ */
+template <class T>
+void Graph<T>::dijkstraShortestPath(const vector<unsigned int> &sources,
+                                    vector<double> &dist, vector<int> &nearest,
+                                    bool reverse) const {
+  vector<int> path;
+  dijkstraShortestPath(sources, dist, nearest, path, reverse);
+}
+
+/*
+ * Same as above, also filling path[i] with the index of the vertex before i
+ * on its shortest path (after i when reverse is set), -1 for the sources and
+ * unreachable vertices. See getPathV(dist, path, dest).
+ */
+template <class T>
+void Graph<T>::dijkstraShortestPath(const vector<unsigned int> &sources,
+                                    vector<double> &dist, vector<int> &nearest,
+                                    vector<int> &path, bool reverse) const {
+  typedef pair<unsigned int, double> Arc;
+  vector<vector<Arc>> incoming;
+  if (reverse) {
+    incoming.resize(vertexSet.size());
+    for (auto v : vertexSet)
+      for (auto &e : v->edgeHashTable)
+        incoming[e.dest->index].push_back(Arc(v->index, e.weight));
+  }
+
+  typedef pair<double, unsigned int> QueueEntry;
+  priority_queue<QueueEntry, vector<QueueEntry>, greater<QueueEntry>> q;
+  dist.assign(vertexSet.size(), INF);
+  nearest.assign(vertexSet.size(), -1);
+  path.assign(vertexSet.size(), -1);
+  for (unsigned int s : sources) {
+    dist[s] = 0;
+    nearest[s] = s;
+    q.push(QueueEntry(0, s));
+  }
+  while (!q.empty()) {
+    QueueEntry top = q.top();
+    q.pop();
+    unsigned int v = top.second;
+    if (top.first > dist[v])
+      continue; // stale entry
+    auto relaxIdx = [&](unsigned int w, double weight) {
+      if (dist[v] + weight < dist[w]) {
+        dist[w] = dist[v] + weight;
+        nearest[w] = nearest[v];
+        path[w] = v;
+        q.push(QueueEntry(dist[w], w));
+      }
+    };
+    if (reverse) {
+      for (auto &a : incoming[v])
+        relaxIdx(a.first, a.second);
+    } else {
+      for (auto &e : vertexSet[v]->edgeHashTable)
+        relaxIdx(e.dest->index, e.weight);
+    }
+  }
+}
+
 template <class T>
 vector<T> Graph<T>::getPath(const T &origin, const T &dest) const {
   vector<T> res;
@@ -498,6 +636,23 @@ vector<Vertex<T> *> Graph<T>::getPathV(const T &origin, const T &dest) const {
   return res;
 }
 
+/*
+ * Path from the closest source of a multi source search to the vertex of
+ * index dest, read from its arrays; empty if dest was not reached.
+ */
+template <class T>
+vector<Vertex<T> *> Graph<T>::getPathV(const vector<double> &dist,
+                                       const vector<int> &path,
+                                       unsigned int dest) const {
+  vector<Vertex<T> *> res;
+  if (dest >= dist.size() || dist[dest] == INF) // missing or disconnected
+    return res;
+  for (int v = dest; v != -1; v = path[v])
+    res.push_back(vertexSet[v]);
+  reverse(res.begin(), res.end());
+  return res;
+}
+
 template <class T> void Graph<T>::unweightedShortestPath(const T &orig) {
   auto s = initSingleSource(orig);
   queue<Vertex<T> *> q;
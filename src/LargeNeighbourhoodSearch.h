@@ -0,0 +1,457 @@
+/*
+ * LargeNeighbourhoodSearch.h
+ *
+ * Ruin and recreate on top of the insertion heuristic. Every iteration
+ * removes a subset of the requests from the routes (at random, related to a
+ * seed request, or the most expensive ones) and puts them back one at a time
+ * in the cheapest place over the whole fleet.
+ *
+ * Several independent searches run on a thread pool, each from the same
+ * initial routes with its own random generator. They share the best cost
+ * found so far through an atomic slot, which steers acceptance
+ * (record-to-record travel around the shared best). Every search keeps its
+ * own best routes and the cheapest of those wins, lowest search first on
+ * ties. With an iteration budget and a single thread, runs are reproducible
+ * for a given seed.
+ *
+ * With loads, capacities or time windows (see RouteSchedule), requests are
+ * only put back where the schedule of the route allows; a candidate where
+ * some request fits nowhere is dropped.
+ */
+
+#ifndef SRC_LARGENEIGHBOURHOODSEARCH_H_
+#define SRC_LARGENEIGHBOURHOODSEARCH_H_
+
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <functional>
+
+#include "DistanceMatrix.h"
+#include "FleetCost.h"
+#include "ThreadPool.h"
+#include "RouteSchedule.h"
+
+#define LNS_MAX_REMOVED 30		// requests removed per iteration, at most
+#define LNS_REMOVED_FRACTION 0.3	// and at most this share of the requests
+#define LNS_DEVIATION 0.01		// accepted excess over the shared best
+#define LNS_WORST_RANDOMNESS 3	// higher picks the worst requests more strictly
+#define LNS_EPSILON 1e-9		// minimum relative gain of an improvement
+
+struct LNSStats{
+	unsigned long iterations = 0, accepted = 0, improvements = 0;
+	unsigned long randomRuins = 0, relatedRuins = 0, worstRuins = 0;
+	unsigned int searches = 0;
+	double initialCost = 0, finalCost = 0;
+	double millis = 0;
+
+	LNSStats & operator+=(const LNSStats &s){
+		iterations += s.iterations;
+		accepted += s.accepted;
+		improvements += s.improvements;
+		randomRuins += s.randomRuins;
+		relatedRuins += s.relatedRuins;
+		worstRuins += s.worstRuins;
+		searches += s.searches;
+		initialCost += s.initialCost;
+		finalCost += s.finalCost;
+		millis = max(millis, s.millis);
+		return *this;
+	}
+};
+
+template<class T>
+class LargeNeighbourhoodSearch{
+
+	typedef chrono::steady_clock Clock;
+
+	struct Solution{
+		vector<vector<unsigned int>> routes;
+		vector<int> owner;		// route of each request, -1 while removed
+		FleetCost fleet;
+		double cost = 0;
+	};
+
+	const DistanceMatrix<T> &d;
+	function<double(const FleetCost &)> objective;
+	vector<pair<unsigned int, unsigned int>> requests;	// pickup and delivery slots
+	vector<RequestConstraint> constraints;
+	vector<double> capacity;	// per route, empty if unlimited
+	vector<RouteEnds> ends;		// per route, empty if all at the origin
+	vector<RouteProfile> profiles;	// per route, empty if all plain
+
+	atomic<double> bestCost;
+	atomic<unsigned long> iterations, accepted, improvements;	// progress, over all searches
+	const atomic<bool> *stop = nullptr;
+	function<void(const vector<vector<unsigned int>> &)> onImprove;
+	mutex reporting;
+
+	RouteEnds endsOf(unsigned int b) const;
+	RouteProfile profileOf(unsigned int b) const;
+	double routeCost(unsigned int b, const vector<unsigned int> &route) const;
+	void match(const Solution &s, vector<int> &pickupPos, vector<int> &deliveryPos, vector<bool> &removable) const;
+	void ruin(Solution &s, const vector<unsigned int> &removed, const vector<int> &pickupPos, const vector<int> &deliveryPos) const;
+	void recreate(Solution &s, const vector<unsigned int> &removed) const;
+	void search(Solution &best, unsigned int index, unsigned int seed, unsigned long maxIterations, double maxMillis, Clock::time_point start, LNSStats &stats);
+
+public:
+	LargeNeighbourhoodSearch(const DistanceMatrix<T> &d, function<double(const FleetCost &)> objective);
+
+	void addRequest(unsigned int pickup, unsigned int delivery, const RequestConstraint &c = RequestConstraint());
+	void setCapacities(const vector<double> &capacity);
+	void setEnds(const vector<RouteEnds> &ends);
+	void setProfiles(const vector<RouteProfile> &profiles);
+	void setProgress(const atomic<bool> *stop, function<void(const vector<vector<unsigned int>> &)> onImprove = nullptr);
+	LNSStats run(vector<vector<unsigned int>> &routes, vector<int> &owner, ThreadPool &pool, unsigned int seed, unsigned long maxIterations, double maxMillis);
+
+	double getBestCost() const;
+	unsigned long getIterations() const;
+	unsigned long getAccepted() const;
+	unsigned long getImprovements() const;
+};
+
+template<class T>
+LargeNeighbourhoodSearch<T>::LargeNeighbourhoodSearch(const DistanceMatrix<T> &d, function<double(const FleetCost &)> objective)
+	: d(d), objective(objective), bestCost(INF), iterations(0), accepted(0), improvements(0){}
+
+template<class T>
+void LargeNeighbourhoodSearch<T>::addRequest(unsigned int pickup, unsigned int delivery, const RequestConstraint &c){
+	requests.push_back(make_pair(pickup, delivery));
+	constraints.push_back(c);
+}
+
+/*
+ * Capacity of every route (none by default); the initial routes must
+ * respect it.
+ */
+template<class T>
+void LargeNeighbourhoodSearch<T>::setCapacities(const vector<double> &capacity){
+	this->capacity = capacity;
+}
+
+/*
+ * Depots every route leaves from and returns to (the origin by default).
+ */
+template<class T>
+void LargeNeighbourhoodSearch<T>::setEnds(const vector<RouteEnds> &ends){
+	this->ends = ends;
+}
+
+/*
+ * Speed, longest duration and costs of every route's vehicle (plain by
+ * default: a route costs its length).
+ */
+template<class T>
+void LargeNeighbourhoodSearch<T>::setProfiles(const vector<RouteProfile> &profiles){
+	this->profiles = profiles;
+}
+
+/*
+ * The searches end early once *stop is set (by any thread), and onImprove
+ * gets the routes of every new best over all searches, from the thread of
+ * the search that found it, one call at a time and best last.
+ */
+template<class T>
+void LargeNeighbourhoodSearch<T>::setProgress(const atomic<bool> *stop, function<void(const vector<vector<unsigned int>> &)> onImprove){
+	this->stop = stop;
+	this->onImprove = onImprove;
+}
+
+/*
+ * Progress of a running search; safe to read from any thread.
+ */
+template<class T>
+double LargeNeighbourhoodSearch<T>::getBestCost() const{return bestCost.load();}
+template<class T>
+unsigned long LargeNeighbourhoodSearch<T>::getIterations() const{return iterations.load();}
+template<class T>
+unsigned long LargeNeighbourhoodSearch<T>::getAccepted() const{return accepted.load();}
+template<class T>
+unsigned long LargeNeighbourhoodSearch<T>::getImprovements() const{return improvements.load();}
+
+template<class T>
+RouteEnds LargeNeighbourhoodSearch<T>::endsOf(unsigned int b) const{
+	return ends.empty() ? RouteEnds() : ends[b];
+}
+
+template<class T>
+RouteProfile LargeNeighbourhoodSearch<T>::profileOf(unsigned int b) const{
+	return profiles.empty() ? RouteProfile() : profiles[b];
+}
+
+/*
+ * Cost of route b as given, from its length (empty: straight from its start
+ * depot to its end one).
+ */
+template<class T>
+double LargeNeighbourhoodSearch<T>::routeCost(unsigned int b, const vector<unsigned int> &route) const{
+	RouteEnds e = endsOf(b);
+	if(route.empty())
+		return profileOf(b).cost(d.get(e.start, e.end), false);
+	double dist = 0;
+	dist += d.get(e.start, route[0]);
+	for(size_t i = 0; i + 1 < route.size(); i++)
+		dist += d.get(route[i], route[i + 1]);
+	dist += d.get(route.back(), e.end);
+	return profileOf(b).cost(dist, true);
+}
+
+/*
+ * Matches every request to the first stop of its pickup and the last stop of
+ * its delivery in its route. Only requests whose two stops serve nothing
+ * else, in the right order, may be removed.
+ */
+template<class T>
+void LargeNeighbourhoodSearch<T>::match(const Solution &s, vector<int> &pickupPos, vector<int> &deliveryPos, vector<bool> &removable) const{
+	vector<int> first(d.size(), -1), last(d.size(), -1);
+	vector<vector<int>> roles(s.routes.size());
+	pickupPos.assign(requests.size(), -1);
+	deliveryPos.assign(requests.size(), -1);
+	removable.assign(requests.size(), false);
+	for(unsigned int b = 0; b < s.routes.size(); b++)
+		roles[b].assign(s.routes[b].size(), 0);
+
+	vector<vector<unsigned int>> byRoute(s.routes.size());
+	for(unsigned int r = 0; r < requests.size(); r++)
+		if(s.owner[r] != -1)
+			byRoute[s.owner[r]].push_back(r);
+	for(unsigned int b = 0; b < s.routes.size(); b++){
+		const vector<unsigned int> &route = s.routes[b];
+		for(int p = route.size() - 1; p >= 0; p--)
+			first[route[p]] = p;
+		for(int p = 0; p < (int)route.size(); p++)
+			last[route[p]] = p;
+		for(unsigned int r : byRoute[b]){
+			pickupPos[r] = first[requests[r].first];
+			deliveryPos[r] = last[requests[r].second];
+			if(pickupPos[r] != -1)
+				roles[b][pickupPos[r]]++;
+			if(deliveryPos[r] != -1)
+				roles[b][deliveryPos[r]]++;
+		}
+		for(unsigned int r : byRoute[b])
+			removable[r] = pickupPos[r] != -1 && pickupPos[r] < deliveryPos[r]
+					&& roles[b][pickupPos[r]] == 1 && roles[b][deliveryPos[r]] == 1;
+		for(unsigned int p = 0; p < route.size(); p++)
+			first[route[p]] = last[route[p]] = -1;
+	}
+}
+
+/*
+ * Takes the stops of the given requests (removable, see match) out of their
+ * routes.
+ */
+template<class T>
+void LargeNeighbourhoodSearch<T>::ruin(Solution &s, const vector<unsigned int> &removed, const vector<int> &pickupPos, const vector<int> &deliveryPos) const{
+	vector<vector<bool>> drop(s.routes.size());
+	for(unsigned int b = 0; b < s.routes.size(); b++)
+		drop[b].assign(s.routes[b].size(), false);
+	for(unsigned int r : removed){
+		drop[s.owner[r]][pickupPos[r]] = true;
+		drop[s.owner[r]][deliveryPos[r]] = true;
+	}
+	for(unsigned int b = 0; b < s.routes.size(); b++){
+		vector<unsigned int> &route = s.routes[b];
+		size_t k = 0;
+		for(size_t p = 0; p < route.size(); p++)
+			if(!drop[b][p])
+				route[k++] = route[p];
+		if(k != route.size()){
+			route.resize(k);
+			s.fleet.update(b, routeCost(b, route));
+		}
+	}
+	for(unsigned int r : removed)
+		s.owner[r] = -1;
+}
+
+/*
+ * Puts the requests back, in the given order, each where it raises the fleet
+ * objective the least. The cost is INF if one of them fits nowhere.
+ */
+template<class T>
+void LargeNeighbourhoodSearch<T>::recreate(Solution &s, const vector<unsigned int> &removed) const{
+	FleetSchedule<T> schedule(d, requests, constraints, capacity, ends, profiles);
+	schedule.reset(s.routes, s.owner);
+
+	for(unsigned int r : removed){
+		unsigned int pickup = requests[r].first, delivery = requests[r].second;
+		double min = INF;
+		unsigned int minRoute = 0;
+		size_t minA = 0, minI = 0;
+		for(unsigned int b = 0; b < s.routes.size(); b++){
+			size_t a = 0, i = 0;
+			double added = schedule.active() ? schedule.cheapestInsertion(b, s.routes[b], r, a, i)
+					: d.cheapestInsertion(s.routes[b], pickup, delivery, a, i, endsOf(b));
+			if(added == INF)
+				continue;
+			double old = s.fleet.getCost(b);
+			s.fleet.update(b, profileOf(b).grown(old, added, !s.routes[b].empty()));
+			double value = objective(s.fleet);
+			s.fleet.update(b, old);
+			if(value < min){
+				min = value;
+				minRoute = b;
+				minA = a;
+				minI = i;
+			}
+		}
+		if(min == INF){
+			s.cost = INF;
+			return;
+		}
+		vector<unsigned int> &route = s.routes[minRoute];
+		route.insert(route.begin() + minI, delivery);
+		route.insert(route.begin() + minA, pickup);
+		s.fleet.update(minRoute, routeCost(minRoute, route));
+		s.owner[r] = minRoute;
+		schedule.assign(r, minRoute, route);
+	}
+	s.cost = objective(s.fleet);
+}
+
+template<class T>
+void LargeNeighbourhoodSearch<T>::search(Solution &best, unsigned int index, unsigned int seed, unsigned long maxIterations, double maxMillis, Clock::time_point start, LNSStats &stats){
+	mt19937 rng(seed + index * 7919);
+	Solution current = best;
+	Solution candidate;
+	vector<int> pickupPos, deliveryPos;
+	vector<bool> removable;
+	vector<unsigned int> pool, removed;
+	vector<pair<double, unsigned int>> ranked;
+
+	for(unsigned long it = 0; maxIterations == 0 || it < maxIterations; it++){
+		if(maxMillis > 0 && chrono::duration<double, milli>(Clock::now() - start).count() >= maxMillis)
+			break;
+		if(stop != nullptr && stop->load())
+			break;
+		candidate = current;
+		match(candidate, pickupPos, deliveryPos, removable);
+		pool.clear();
+		for(unsigned int r = 0; r < requests.size(); r++)
+			if(removable[r])
+				pool.push_back(r);
+		if(pool.empty())
+			break;
+		size_t limit = std::min((size_t)LNS_MAX_REMOVED, std::max((size_t)1, (size_t)(requests.size() * LNS_REMOVED_FRACTION)));
+		size_t k = 1 + rng() % std::min(limit, pool.size());
+
+		removed.clear();
+		ranked.clear();
+		unsigned int op = rng() % 3;
+		if(op == 0){
+			//random requests
+			shuffle(pool.begin(), pool.end(), rng);
+			removed.assign(pool.begin(), pool.begin() + k);
+			stats.randomRuins++;
+		}
+		else if(op == 1){
+			//requests close to a random one, at both ends
+			unsigned int seedReq = pool[rng() % pool.size()];
+			auto near = [&](unsigned int a, unsigned int b){return std::min(d.get(a, b), d.get(b, a));};
+			for(unsigned int r : pool)
+				ranked.push_back(make_pair(near(requests[r].first, requests[seedReq].first)
+						+ near(requests[r].second, requests[seedReq].second), r));
+			partial_sort(ranked.begin(), ranked.begin() + k, ranked.end());
+			for(size_t i = 0; i < k; i++)
+				removed.push_back(ranked[i].second);
+			stats.relatedRuins++;
+		}
+		else{
+			//requests whose stops cost the most, with some randomness
+			for(unsigned int r : pool){
+				const vector<unsigned int> &route = candidate.routes[candidate.owner[r]];
+				RouteEnds e = endsOf(candidate.owner[r]);
+				int pp = pickupPos[r], dp = deliveryPos[r];
+				auto at = [&](int p){return p < 0 ? e.start : (p >= (int)route.size() ? e.end : route[p]);};
+				double gain;
+				if(dp == pp + 1)
+					gain = d.get(at(pp - 1), at(pp)) + d.get(at(pp), at(dp)) + d.get(at(dp), at(dp + 1)) - d.get(at(pp - 1), at(dp + 1));
+				else
+					gain = d.get(at(pp - 1), at(pp)) + d.get(at(pp), at(pp + 1)) - d.get(at(pp - 1), at(pp + 1))
+							+ d.get(at(dp - 1), at(dp)) + d.get(at(dp), at(dp + 1)) - d.get(at(dp - 1), at(dp + 1));
+				ranked.push_back(make_pair(-gain, r));
+			}
+			sort(ranked.begin(), ranked.end());
+			uniform_real_distribution<double> u(0, 1);
+			while(removed.size() < k){
+				size_t i = (size_t)(pow(u(rng), LNS_WORST_RANDOMNESS) * ranked.size());
+				removed.push_back(ranked[i].second);
+				ranked.erase(ranked.begin() + i);
+			}
+			stats.worstRuins++;
+		}
+
+		ruin(candidate, removed, pickupPos, deliveryPos);
+		shuffle(removed.begin(), removed.end(), rng);
+		recreate(candidate, removed);
+		stats.iterations++;
+		iterations++;
+
+		double shared = bestCost.load();
+		if(candidate.cost < current.cost - LNS_EPSILON * (1 + current.cost) || candidate.cost < shared * (1 + LNS_DEVIATION)){
+			swap(current, candidate);
+			stats.accepted++;
+			accepted++;
+			if(current.cost < best.cost - LNS_EPSILON * (1 + best.cost)){
+				best = current;
+				stats.improvements++;
+				improvements++;
+				while(best.cost < shared && !bestCost.compare_exchange_weak(shared, best.cost));
+				if(onImprove){
+					//a search that has been beaten since does not report
+					lock_guard<mutex> lock(reporting);
+					if(best.cost <= bestCost.load())
+						onImprove(best.routes);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Improves the routes (and request owners) in place, with one search per
+ * thread of the pool. Each search stops after maxIterations iterations or
+ * maxMillis milliseconds; 0 means no limit, but one of them must be set.
+ */
+template<class T>
+LNSStats LargeNeighbourhoodSearch<T>::run(vector<vector<unsigned int>> &routes, vector<int> &owner, ThreadPool &pool, unsigned int seed, unsigned long maxIterations, double maxMillis){
+	LNSStats total;
+	if(requests.empty() || routes.empty() || (maxIterations == 0 && maxMillis == 0))
+		return total;
+	Clock::time_point start = Clock::now();
+
+	Solution initial;
+	initial.routes = routes;
+	initial.owner = owner;
+	initial.fleet.reset(routes.size());
+	for(unsigned int b = 0; b < routes.size(); b++)
+		initial.fleet.update(b, routeCost(b, routes[b]));
+	initial.cost = objective(initial.fleet);
+	bestCost = initial.cost;
+	iterations = accepted = improvements = 0;
+
+	unsigned int searches = pool.size();
+	vector<Solution> best(searches, initial);
+	vector<LNSStats> stats(searches);
+	pool.parallelFor(searches, [&](size_t i){
+		search(best[i], i, seed, maxIterations, maxMillis, start, stats[i]);
+	});
+
+	unsigned int winner = 0;
+	for(unsigned int i = 0; i < searches; i++){
+		total += stats[i];
+		if(best[i].cost < best[winner].cost)
+			winner = i;
+	}
+	routes = best[winner].routes;
+	owner = best[winner].owner;
+	total.searches = searches;
+	total.initialCost = initial.cost;
+	total.finalCost = best[winner].cost;
+	total.millis = chrono::duration<double, milli>(Clock::now() - start).count();
+	return total;
+}
+
+#endif /* SRC_LARGENEIGHBOURHOODSEARCH_H_ */
@@ -0,0 +1,906 @@
+/*
+ * LocalSearch.h
+ *
+ * Improvement phase for the routes built by the greedy insertion. Moves
+ * within a route: or-opt (relocate 1 to 3 consecutive stops), exchange of two
+ * stops and 2-opt (reverse a segment). Moves between routes: relocate a
+ * request, exchange two requests and 2-opt* (swap the tails of two routes).
+ *
+ * Stop moves are scored in O(1) from the distance matrix and prefix sums of
+ * the routes, and pickup-before-delivery is checked in O(1) from per stop
+ * bounds. Candidates are restricted to granular neighbour lists: a move is
+ * only tried if one of the edges it creates joins two close slots.
+ * Improving moves are applied as soon as they are found, until no move
+ * improves or the budget runs out.
+ *
+ * With loads, capacities or time windows (see RouteSchedule), requests are
+ * only inserted where the schedule of the route allows, checked in O(1) per
+ * place; the few stop moves and tail swaps that improve are checked by
+ * simulating the new routes before they are applied.
+ */
+
+#ifndef SRC_LOCALSEARCH_H_
+#define SRC_LOCALSEARCH_H_
+
+#include <chrono>
+#include <atomic>
+#include <functional>
+
+#include "DistanceMatrix.h"
+#include "FleetCost.h"
+#include "RouteSchedule.h"
+
+#define LS_NEIGHBOURS 10	// size of the granular neighbour lists
+#define LS_EPSILON 1e-9		// minimum relative gain of an applied move
+
+struct LocalSearchStats{
+	unsigned long evaluated = 0;
+	unsigned int orOpt = 0, exchange = 0, twoOpt = 0;
+	unsigned int relocateRequest = 0, exchangeRequests = 0, twoOptStar = 0;
+	double initialCost = 0, finalCost = 0;
+	double millis = 0;
+
+	unsigned int applied() const{
+		return orOpt + exchange + twoOpt + relocateRequest + exchangeRequests + twoOptStar;
+	}
+	LocalSearchStats & operator+=(const LocalSearchStats &s){
+		evaluated += s.evaluated;
+		orOpt += s.orOpt;
+		exchange += s.exchange;
+		twoOpt += s.twoOpt;
+		relocateRequest += s.relocateRequest;
+		exchangeRequests += s.exchangeRequests;
+		twoOptStar += s.twoOptStar;
+		initialCost += s.initialCost;
+		finalCost += s.finalCost;
+		millis += s.millis;
+		return *this;
+	}
+};
+
+template<class T>
+class LocalSearch{
+
+	typedef chrono::steady_clock Clock;
+
+	const DistanceMatrix<T> &d;
+	vector<vector<unsigned int>> &routes;
+	FleetCost &fleet;
+	function<double(const FleetCost &)> objective;
+
+	vector<pair<unsigned int, unsigned int>> requests;	// pickup and delivery slots
+	vector<RequestConstraint> constraints;
+	vector<double> capacity;			// per route, empty if unlimited
+	vector<RouteEnds> ends;				// per route, empty if all at the origin
+	vector<RouteProfile> profiles;		// per route, empty if all plain
+	bool constrained = false;
+	vector<double> lengths;				// per route
+	vector<int> owner;					// route of each request
+	vector<int> pickupPos, deliveryPos;	// matched stops in the owner route
+	vector<bool> active;				// precedence held in the initial routes
+
+	vector<vector<unsigned int>> neighbours;	// per slot, closest first
+	vector<vector<pair<unsigned int, unsigned int>>> stops;	// per slot, (route, position)
+	vector<bool> endDepot;					// per slot, whether some route ends there
+
+	struct RouteState{
+		vector<unsigned int> requests;
+		vector<vector<int>> after;		// per stop, deliveries of the pickups made there
+		vector<vector<int>> before;		// per stop, pickups of the deliveries made there
+		vector<int> hi;					// per stop, first of after (L if none)
+		vector<int> lo;					// per stop, last of before (-1 if none)
+		vector<int> suffixHi;			// min of hi from the stop on
+		vector<int> roles;				// per stop, requests matched to it
+		vector<int> open;				// per cut, requests spanning it (cut x + 1 is after stop x)
+		vector<double> pre;				// depot to stop p along the route
+		vector<double> rev;				// stop 0 to stop p walked backwards
+		RouteSchedule<T> schedule;		// only kept when constrained
+	};
+	vector<RouteState> state;
+
+	vector<int> firstStop, lastStop;	// scratch, per slot
+	vector<unsigned int> scratchA, scratchB;
+	RouteSchedule<T> scheduleA, scheduleB;
+
+	unsigned int maxMoves;
+	double maxMillis;
+	Clock::time_point start;
+	bool expired = false;
+	LocalSearchStats stats;
+	const atomic<bool> *stop = nullptr;
+	function<void()> onImprove;
+
+	RouteEnds endsOf(unsigned int b) const;
+	unsigned int slot(unsigned int b, int p) const;
+	RouteProfile profileOf(unsigned int b) const;
+	double length(unsigned int b) const;
+	double headCost(unsigned int b, int x) const;
+	double tailCost(unsigned int b, int k, unsigned int end) const;
+	bool closed(unsigned int b, int x) const;
+	bool relocatable(unsigned int r) const;
+	double capacityOf(unsigned int b) const;
+	bool feasible(unsigned int b, const vector<unsigned int> &route, const vector<unsigned int> &served) const;
+	void scheduleWithout(unsigned int b, unsigned int r, const vector<unsigned int> &route, RouteSchedule<T> &out) const;
+	bool tick();
+	bool improves(double delta, double base) const;
+
+	void buildNeighbours();
+	void rebuild(unsigned int b);
+	void rebuildStops();
+	void commit(unsigned int b);
+
+	double removalGain(unsigned int r) const;
+	void removeRequest(unsigned int r, vector<unsigned int> &out) const;
+	double bestInsertion(unsigned int b, const vector<unsigned int> &route, const RouteSchedule<T> &schedule, unsigned int r, size_t &bestA, size_t &bestI);
+	void insert(vector<unsigned int> &route, unsigned int pickup, unsigned int delivery, size_t a, size_t i) const;
+	bool acceptPair(unsigned int A, double lengthA, unsigned int B, double lengthB, bool usedA = true, bool usedB = true) const;
+
+	bool orOpt(unsigned int b);
+	bool exchange(unsigned int b);
+	bool twoOpt(unsigned int b);
+	bool relocateRequest();
+	bool exchangeRequests();
+	bool twoOptStar();
+
+public:
+	LocalSearch(const DistanceMatrix<T> &d, vector<vector<unsigned int>> &routes, FleetCost &fleet, function<double(const FleetCost &)> objective);
+
+	void addRequest(unsigned int pickup, unsigned int delivery, int route, const RequestConstraint &c = RequestConstraint());
+	void setCapacities(const vector<double> &capacity);
+	void setEnds(const vector<RouteEnds> &ends);
+	void setProfiles(const vector<RouteProfile> &profiles);
+	void setProgress(const atomic<bool> *stop, function<void()> onImprove = nullptr);
+	LocalSearchStats run(unsigned int maxMoves, double maxMillis);
+	int getRoute(unsigned int r) const;
+};
+
+/*
+ * fleet must hold the cost of every route (see setProfiles); objective gives the value to
+ * minimise for a fleet (e.g. total, or total plus longest route).
+ */
+template<class T>
+LocalSearch<T>::LocalSearch(const DistanceMatrix<T> &d, vector<vector<unsigned int>> &routes, FleetCost &fleet, function<double(const FleetCost &)> objective)
+	: d(d), routes(routes), fleet(fleet), objective(objective){}
+
+/*
+ * Declares a request served by a route, or by none (-1): such a request is
+ * left alone. Requests must all be added before run() is called.
+ */
+template<class T>
+void LocalSearch<T>::addRequest(unsigned int pickup, unsigned int delivery, int route, const RequestConstraint &c){
+	requests.push_back(make_pair(pickup, delivery));
+	constraints.push_back(c);
+	owner.push_back(route);
+}
+
+/*
+ * Route that serves request r (in the order they were added), which moves
+ * may have changed; -1 if it was added without one.
+ */
+template<class T>
+int LocalSearch<T>::getRoute(unsigned int r) const{return owner[r];}
+
+/*
+ * Capacity of every route (none by default). The routes given must already
+ * respect the capacities and windows; moves keep them feasible.
+ */
+template<class T>
+void LocalSearch<T>::setCapacities(const vector<double> &capacity){
+	this->capacity = capacity;
+}
+
+/*
+ * Depots every route leaves from and returns to (the origin by default).
+ * Routes may trade requests and tails across depots.
+ */
+template<class T>
+void LocalSearch<T>::setEnds(const vector<RouteEnds> &ends){
+	this->ends = ends;
+}
+
+/*
+ * Speed, longest duration and costs of every route's vehicle (plain by
+ * default: a route costs its length). fleet must hold the costs as the
+ * profiles give them; moves are then weighed by cost, not length.
+ */
+template<class T>
+void LocalSearch<T>::setProfiles(const vector<RouteProfile> &profiles){
+	this->profiles = profiles;
+}
+
+/*
+ * The search ends early once *stop is set (by any thread), and onImprove is
+ * called after every move applied, when the routes and fleet are up to
+ * date.
+ */
+template<class T>
+void LocalSearch<T>::setProgress(const atomic<bool> *stop, function<void()> onImprove){
+	this->stop = stop;
+	this->onImprove = onImprove;
+}
+
+template<class T>
+inline RouteEnds LocalSearch<T>::endsOf(unsigned int b) const{
+	return ends.empty() ? RouteEnds() : ends[b];
+}
+
+template<class T>
+inline unsigned int LocalSearch<T>::slot(unsigned int b, int p) const{
+	if(p < 0)
+		return endsOf(b).start;
+	return p >= (int)routes[b].size() ? endsOf(b).end : routes[b][p];
+}
+
+template<class T>
+inline RouteProfile LocalSearch<T>::profileOf(unsigned int b) const{
+	return profiles.empty() ? RouteProfile() : profiles[b];
+}
+
+template<class T>
+inline double LocalSearch<T>::length(unsigned int b) const{return lengths[b];}
+
+/*
+ * Length from the depot through stops 0 .. x of route b (0 if x < 0).
+ */
+template<class T>
+inline double LocalSearch<T>::headCost(unsigned int b, int x) const{
+	return x < 0 ? 0 : state[b].pre[x];
+}
+
+/*
+ * Length from stop k of route b to the given end depot (0 if k is past the
+ * end).
+ */
+template<class T>
+inline double LocalSearch<T>::tailCost(unsigned int b, int k, unsigned int end) const{
+	const vector<unsigned int> &route = routes[b];
+	if(k >= (int)route.size())
+		return 0;
+	double tail = length(b) - state[b].pre[k];
+	unsigned int own = endsOf(b).end;
+	if(end != own)
+		tail += d.get(route.back(), end) - d.get(route.back(), own);
+	return tail;
+}
+
+/*
+ * Whether no request of route b has its pickup at or before stop x and its
+ * delivery after it, so the route can be cut after x.
+ */
+template<class T>
+inline bool LocalSearch<T>::closed(unsigned int b, int x) const{
+	return state[b].open[x + 1] == 0;
+}
+
+/*
+ * A request can leave its route if its two stops serve nothing else.
+ */
+template<class T>
+inline bool LocalSearch<T>::relocatable(unsigned int r) const{
+	if(!active[r])
+		return false;
+	const RouteState &s = state[owner[r]];
+	return s.roles[pickupPos[r]] == 1 && s.roles[deliveryPos[r]] == 1;
+}
+
+template<class T>
+inline double LocalSearch<T>::capacityOf(unsigned int b) const{
+	return capacity.empty() ? INF : capacity[b];
+}
+
+/*
+ * Whether route b may become the given route, serving the given requests.
+ */
+template<class T>
+bool LocalSearch<T>::feasible(unsigned int b, const vector<unsigned int> &route, const vector<unsigned int> &served) const{
+	if(!constrained)
+		return true;
+	RouteSchedule<T> schedule;
+	schedule.build(d, route, requests, constraints, served, capacityOf(b), endsOf(b), profileOf(b));
+	return schedule.feasible();
+}
+
+/*
+ * Schedule of route b with request r taken out (route), when constrained.
+ */
+template<class T>
+void LocalSearch<T>::scheduleWithout(unsigned int b, unsigned int r, const vector<unsigned int> &route, RouteSchedule<T> &out) const{
+	if(!constrained)
+		return;
+	vector<unsigned int> served;
+	for(unsigned int q : state[b].requests)
+		if(q != r)
+			served.push_back(q);
+	out.build(d, route, requests, constraints, served, capacityOf(b), endsOf(b), profileOf(b));
+}
+
+/*
+ * Counts an evaluated move; false once the budget is spent.
+ */
+template<class T>
+inline bool LocalSearch<T>::tick(){
+	if(expired)
+		return false;
+	if((++stats.evaluated & 255) == 0 && ((maxMillis > 0 && chrono::duration<double, milli>(Clock::now() - start).count() >= maxMillis)
+			|| (stop != nullptr && stop->load())))
+		expired = true;
+	return !expired;
+}
+
+template<class T>
+inline bool LocalSearch<T>::improves(double delta, double base) const{
+	return delta < -LS_EPSILON * (1 + base);
+}
+
+template<class T>
+void LocalSearch<T>::buildNeighbours(){
+	unsigned int n = d.size();
+	neighbours.assign(n, vector<unsigned int>());
+	vector<pair<double, unsigned int>> v;
+	for(unsigned int a = 0; a < n; a++){
+		v.clear();
+		for(unsigned int b = 0; b < n; b++)
+			if(b != a)
+				v.push_back(make_pair(std::min(d.get(a, b), d.get(b, a)), b));
+		size_t k = std::min((size_t)LS_NEIGHBOURS, v.size());
+		partial_sort(v.begin(), v.begin() + k, v.end());
+		for(size_t i = 0; i < k; i++)
+			neighbours[a].push_back(v[i].second);
+	}
+}
+
+/*
+ * Matches the requests of route b to its stops (first stop of the pickup,
+ * last stop of the delivery) and recomputes the bounds and prefix sums.
+ */
+template<class T>
+void LocalSearch<T>::rebuild(unsigned int b){
+	const vector<unsigned int> &route = routes[b];
+	RouteState &s = state[b];
+	int L = route.size();
+
+	for(int p = L - 1; p >= 0; p--)
+		firstStop[route[p]] = p;
+	for(int p = 0; p < L; p++)
+		lastStop[route[p]] = p;
+
+	s.after.assign(L, vector<int>());
+	s.before.assign(L, vector<int>());
+	s.roles.assign(L, 0);
+	s.open.assign(L + 1, 0);
+	for(unsigned int r : s.requests){
+		int pp = firstStop[requests[r].first];
+		int dp = lastStop[requests[r].second];
+		pickupPos[r] = pp;
+		deliveryPos[r] = dp;
+		if(pp == -1 || dp == -1)
+			continue;
+		s.roles[pp]++;
+		s.roles[dp]++;
+		if(!active[r])
+			continue;
+		s.after[pp].push_back(dp);
+		s.before[dp].push_back(pp);
+		s.open[pp + 1]++;
+		s.open[dp + 1]--;
+	}
+	for(int x = 1; x <= L; x++)
+		s.open[x] += s.open[x - 1];
+	for(int p = 0; p < L; p++)
+		firstStop[route[p]] = lastStop[route[p]] = -1;
+
+	s.hi.assign(L, L);
+	s.lo.assign(L, -1);
+	for(int p = 0; p < L; p++){
+		for(int q : s.after[p])
+			s.hi[p] = std::min(s.hi[p], q);
+		for(int q : s.before[p])
+			s.lo[p] = std::max(s.lo[p], q);
+	}
+	s.suffixHi.assign(L + 1, L);
+	for(int p = L - 1; p >= 0; p--)
+		s.suffixHi[p] = std::min(s.suffixHi[p + 1], s.hi[p]);
+
+	s.pre.assign(L, 0);
+	s.rev.assign(L, 0);
+	for(int p = 0; p < L; p++){
+		s.pre[p] = (p == 0) ? d.get(endsOf(b).start, route[0]) : s.pre[p - 1] + d.get(route[p - 1], route[p]);
+		s.rev[p] = (p == 0) ? 0 : s.rev[p - 1] + d.get(route[p], route[p - 1]);
+	}
+	if(constrained)
+		s.schedule.build(d, route, requests, constraints, s.requests, capacityOf(b), endsOf(b), profileOf(b));
+}
+
+template<class T>
+void LocalSearch<T>::rebuildStops(){
+	for(auto &v : stops)
+		v.clear();
+	for(unsigned int b = 0; b < routes.size(); b++)
+		for(unsigned int p = 0; p < routes[b].size(); p++)
+			stops[routes[b][p]].push_back(make_pair(b, p));
+}
+
+/*
+ * Stores the exact length and cost of a changed route and its new state. An
+ * empty route still drives from its start depot to its end one.
+ */
+template<class T>
+void LocalSearch<T>::commit(unsigned int b){
+	rebuild(b);
+	const vector<unsigned int> &route = routes[b];
+	RouteEnds e = endsOf(b);
+	lengths[b] = route.empty() ? d.get(e.start, e.end) : state[b].pre.back() + d.get(route.back(), e.end);
+	fleet.update(b, profileOf(b).cost(lengths[b], !route.empty()));
+}
+
+/*
+ * Length saved by taking the stops of request r out of its route.
+ */
+template<class T>
+double LocalSearch<T>::removalGain(unsigned int r) const{
+	unsigned int b = owner[r];
+	int pp = pickupPos[r], dp = deliveryPos[r];
+	unsigned int P = slot(b, pp), D = slot(b, dp);
+	if(dp == pp + 1){
+		unsigned int prev = slot(b, pp - 1), next = slot(b, dp + 1);
+		return d.get(prev, P) + d.get(P, D) + d.get(D, next) - d.get(prev, next);
+	}
+	unsigned int a = slot(b, pp - 1), c = slot(b, pp + 1);
+	unsigned int e = slot(b, dp - 1), f = slot(b, dp + 1);
+	return d.get(a, P) + d.get(P, c) - d.get(a, c) + d.get(e, D) + d.get(D, f) - d.get(e, f);
+}
+
+template<class T>
+void LocalSearch<T>::removeRequest(unsigned int r, vector<unsigned int> &out) const{
+	const vector<unsigned int> &route = routes[owner[r]];
+	out.clear();
+	for(int p = 0; p < (int)route.size(); p++)
+		if(p != pickupPos[r] && p != deliveryPos[r])
+			out.push_back(route[p]);
+}
+
+/*
+ * Cheapest place for request r in a route of the depots of route b (see
+ * DistanceMatrix), feasible for the schedule of the route when constrained;
+ * INF if there is none or once the budget is spent.
+ */
+template<class T>
+double LocalSearch<T>::bestInsertion(unsigned int b, const vector<unsigned int> &route, const RouteSchedule<T> &schedule, unsigned int r, size_t &bestA, size_t &bestI){
+	if(!tick())
+		return INF;
+	if(constrained)
+		return schedule.cheapestInsertion(route, r, bestA, bestI);
+	return d.cheapestInsertion(route, requests[r].first, requests[r].second, bestA, bestI, endsOf(b));
+}
+
+template<class T>
+void LocalSearch<T>::insert(vector<unsigned int> &route, unsigned int pickup, unsigned int delivery, size_t a, size_t i) const{
+	route.insert(route.begin() + i, delivery);
+	route.insert(route.begin() + a, pickup);
+}
+
+/*
+ * Whether giving routes A and B the new lengths (with or without stops)
+ * lowers the objective.
+ */
+template<class T>
+bool LocalSearch<T>::acceptPair(unsigned int A, double lengthA, unsigned int B, double lengthB, bool usedA, bool usedB) const{
+	double oldA = fleet.getCost(A), oldB = fleet.getCost(B);
+	double before = objective(fleet);
+	fleet.update(A, profileOf(A).cost(lengthA, usedA));
+	fleet.update(B, profileOf(B).cost(lengthB, usedB));
+	double after = objective(fleet);
+	fleet.update(A, oldA);
+	fleet.update(B, oldB);
+	return improves(after - before, before);
+}
+
+/*
+ * Moves a block of 1 to 3 consecutive stops right after a stop that is a
+ * neighbour of its first one (or to the front, for the depot).
+ */
+template<class T>
+bool LocalSearch<T>::orOpt(unsigned int b){
+	vector<unsigned int> &route = routes[b];
+	const RouteState &s = state[b];
+	int L = route.size();
+	for(int len = 1; len <= 3; len++){
+		for(int i = 0; i + len <= L; i++){
+			int j = i + len - 1;
+			unsigned int first = route[i], last = route[j];
+			unsigned int prev = slot(b, i - 1), next = slot(b, j + 1);
+			double gain = d.get(prev, first) + d.get(last, next) - d.get(prev, next);
+
+			//dependencies leaving the block
+			int hiOut = L, loOut = -1;
+			for(int p = i; p <= j; p++){
+				for(int q : s.after[p])
+					if(q > j)
+						hiOut = std::min(hiOut, q);
+				for(int q : s.before[p])
+					if(q < i)
+						loOut = std::max(loOut, q);
+			}
+
+			auto tryAfter = [&](int k){
+				if(k >= i - 1 && k <= j)
+					return false;
+				if(!tick())
+					return false;
+				if(k > j ? hiOut <= k : loOut > k)
+					return false;
+				unsigned int u = slot(b, k), w = slot(b, k + 1);
+				double delta = d.get(u, first) + d.get(last, w) - d.get(u, w) - gain;
+				if(!improves(delta, length(b)))
+					return false;
+				scratchA = route;
+				vector<unsigned int> block(route.begin() + i, route.begin() + j + 1);
+				scratchA.erase(scratchA.begin() + i, scratchA.begin() + j + 1);
+				int at = (k > j) ? k + 1 - len : k + 1;
+				scratchA.insert(scratchA.begin() + at, block.begin(), block.end());
+				if(!feasible(b, scratchA, s.requests))
+					return false;
+				route.swap(scratchA);
+				return true;
+			};
+			for(unsigned int v : neighbours[first]){
+				if(v == endsOf(b).start && tryAfter(-1))
+					return true;
+				for(auto &st : stops[v])
+					if(st.first == b && tryAfter(st.second))
+						return true;
+			}
+			if(expired)
+				return false;
+		}
+	}
+	return false;
+}
+
+/*
+ * Swaps stops p < q, where the stop before p is a neighbour of q's.
+ */
+template<class T>
+bool LocalSearch<T>::exchange(unsigned int b){
+	vector<unsigned int> &route = routes[b];
+	const RouteState &s = state[b];
+	int L = route.size();
+	for(int p = 0; p < L; p++){
+		unsigned int a = slot(b, p - 1), sp = route[p];
+		for(unsigned int v : neighbours[a]){
+			for(auto &st : stops[v]){
+				int q = st.second;
+				if(st.first != b || q <= p)
+					continue;
+				if(!tick())
+					return false;
+				if(s.hi[p] <= q || s.lo[q] >= p)
+					continue;
+				unsigned int sq = route[q], f = slot(b, q + 1);
+				double delta;
+				if(q == p + 1)
+					delta = d.get(a, sq) + d.get(sq, sp) + d.get(sp, f) - d.get(a, sp) - d.get(sp, sq) - d.get(sq, f);
+				else{
+					unsigned int c = route[p + 1], e = route[q - 1];
+					delta = d.get(a, sq) + d.get(sq, c) + d.get(e, sp) + d.get(sp, f)
+							- d.get(a, sp) - d.get(sp, c) - d.get(e, sq) - d.get(sq, f);
+				}
+				if(improves(delta, length(b))){
+					swap(route[p], route[q]);
+					if(feasible(b, route, s.requests))
+						return true;
+					swap(route[p], route[q]);
+				}
+			}
+		}
+	}
+	return false;
+}
+
+/*
+ * Reverses stops i .. j, where the stop before i is a neighbour of j's. No
+ * request may have both stops inside the segment.
+ */
+template<class T>
+bool LocalSearch<T>::twoOpt(unsigned int b){
+	vector<unsigned int> &route = routes[b];
+	const RouteState &s = state[b];
+	int L = route.size();
+	for(int i = 0; i < L; i++){
+		unsigned int a = slot(b, i - 1);
+		for(unsigned int v : neighbours[a]){
+			for(auto &st : stops[v]){
+				int j = st.second;
+				if(st.first != b || j <= i + 1)
+					continue;
+				if(!tick())
+					return false;
+				if(s.suffixHi[i] <= j)
+					continue;
+				unsigned int f = slot(b, j + 1);
+				double delta = d.get(a, route[j]) + (s.rev[j] - s.rev[i]) + d.get(route[i], f)
+						- d.get(a, route[i]) - (s.pre[j] - s.pre[i]) - d.get(route[j], f);
+				if(improves(delta, length(b))){
+					reverse(route.begin() + i, route.begin() + j + 1);
+					if(feasible(b, route, s.requests))
+						return true;
+					reverse(route.begin() + i, route.begin() + j + 1);
+				}
+			}
+		}
+	}
+	return false;
+}
+
+/*
+ * Moves a request to the cheapest place in another route holding a
+ * neighbour of its pickup (or in an empty route, one per pair of depots).
+ */
+template<class T>
+bool LocalSearch<T>::relocateRequest(){
+	vector<bool> tried(routes.size());
+	for(unsigned int r = 0; r < requests.size(); r++){
+		if(!relocatable(r))
+			continue;
+		unsigned int A = owner[r];
+		double lengthA = length(A) - removalGain(r);
+		bool usedA = routes[A].size() > 2;
+		fill(tried.begin(), tried.end(), false);
+		tried[A] = true;
+		vector<RouteEnds> triedEmpty;
+
+		auto tryRoute = [&](unsigned int B){
+			if(tried[B])
+				return false;
+			tried[B] = true;
+			size_t a = 0, i = 0;
+			double added = bestInsertion(B, routes[B], state[B].schedule, r, a, i);
+			if(added == INF || !acceptPair(A, lengthA, B, length(B) + added, usedA))
+				return false;
+			removeRequest(r, scratchA);
+			routes[A].swap(scratchA);
+			insert(routes[B], requests[r].first, requests[r].second, a, i);
+			state[A].requests.erase(find(state[A].requests.begin(), state[A].requests.end(), r));
+			state[B].requests.push_back(r);
+			owner[r] = B;
+			return true;
+		};
+		for(unsigned int v : neighbours[requests[r].first])
+			for(auto &st : stops[v])
+				if(tryRoute(st.first)){
+					commit(A);
+					commit(st.first);
+					return true;
+				}
+		for(unsigned int B = 0; B < routes.size(); B++)
+			if(routes[B].empty() && find(triedEmpty.begin(), triedEmpty.end(), endsOf(B)) == triedEmpty.end()){
+				triedEmpty.push_back(endsOf(B));
+				if(tryRoute(B)){
+					commit(A);
+					commit(B);
+					return true;
+				}
+			}
+		if(expired)
+			return false;
+	}
+	return false;
+}
+
+/*
+ * Swaps two requests of different routes whose pickups are neighbours, each
+ * going to the cheapest place in its new route.
+ */
+template<class T>
+bool LocalSearch<T>::exchangeRequests(){
+	for(unsigned int r1 = 0; r1 < requests.size(); r1++){
+		if(!relocatable(r1))
+			continue;
+		unsigned int A = owner[r1];
+		for(unsigned int v : neighbours[requests[r1].first]){
+			for(auto &st : stops[v]){
+				unsigned int B = st.first;
+				if(B == A)
+					continue;
+				for(unsigned int r2 : state[B].requests){
+					if(pickupPos[r2] != (int)st.second || !relocatable(r2))
+						continue;
+					removeRequest(r1, scratchA);
+					removeRequest(r2, scratchB);
+					scheduleWithout(A, r1, scratchA, scheduleA);
+					scheduleWithout(B, r2, scratchB, scheduleB);
+					size_t a1 = 0, i1 = 0, a2 = 0, i2 = 0;
+					double addA = bestInsertion(A, scratchA, scheduleA, r2, a2, i2);
+					double addB = bestInsertion(B, scratchB, scheduleB, r1, a1, i1);
+					if(expired)
+						return false;
+					if(addA == INF || addB == INF)
+						continue;
+					double lengthA = length(A) - removalGain(r1) + addA;
+					double lengthB = length(B) - removalGain(r2) + addB;
+					if(!acceptPair(A, lengthA, B, lengthB))
+						continue;
+					insert(scratchA, requests[r2].first, requests[r2].second, a2, i2);
+					insert(scratchB, requests[r1].first, requests[r1].second, a1, i1);
+					routes[A].swap(scratchA);
+					routes[B].swap(scratchB);
+					replace(state[A].requests.begin(), state[A].requests.end(), r1, r2);
+					replace(state[B].requests.begin(), state[B].requests.end(), r2, r1);
+					owner[r1] = B;
+					owner[r2] = A;
+					commit(A);
+					commit(B);
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+/*
+ * Cuts routes A and B where no request spans the cut and swaps the tails,
+ * each of which then ends at the depot of its new route. The new edge joins
+ * neighbours, or the tail of A goes to the end of B when B's end depot is a
+ * neighbour of A's last kept stop.
+ */
+template<class T>
+bool LocalSearch<T>::twoOptStar(){
+	for(unsigned int A = 0; A < routes.size(); A++){
+		int LA = routes[A].size();
+		for(int x = 0; x < LA; x++){
+			if(!closed(A, x))
+				continue;
+			unsigned int u = routes[A][x];
+
+			auto tryCut = [&](unsigned int B, int k){
+				if(B == A || !closed(B, k - 1))
+					return false;
+				if(!tick())
+					return false;
+				unsigned int endA = endsOf(A).end, endB = endsOf(B).end;
+				unsigned int toA = (k < (int)routes[B].size()) ? routes[B][k] : endA;
+				unsigned int toB = (x + 1 < LA) ? routes[A][x + 1] : endB;
+				double lengthA = headCost(A, x) + d.get(u, toA) + tailCost(B, k, endA);
+				double lengthB = headCost(B, k - 1) + d.get(slot(B, k - 1), toB) + tailCost(A, x + 1, endB);
+				if(!acceptPair(A, lengthA, B, lengthB, true, k + (LA - x - 1) > 0))
+					return false;
+				vector<unsigned int> &ra = routes[A], &rb = routes[B];
+				scratchA.assign(ra.begin(), ra.begin() + x + 1);
+				scratchA.insert(scratchA.end(), rb.begin() + k, rb.end());
+				scratchB.assign(rb.begin(), rb.begin() + k);
+				scratchB.insert(scratchB.end(), ra.begin() + x + 1, ra.end());
+				vector<unsigned int> moveToB, moveToA;
+				for(unsigned int r : state[A].requests)
+					(pickupPos[r] > x ? moveToB : moveToA).push_back(r);
+				for(unsigned int r : state[B].requests)
+					(pickupPos[r] >= k ? moveToA : moveToB).push_back(r);
+				if(!feasible(A, scratchA, moveToA) || !feasible(B, scratchB, moveToB))
+					return false;
+				ra.swap(scratchA);
+				rb.swap(scratchB);
+				state[A].requests = moveToA;
+				state[B].requests = moveToB;
+				for(unsigned int r : moveToA)
+					owner[r] = A;
+				for(unsigned int r : moveToB)
+					owner[r] = B;
+				commit(A);
+				commit(B);
+				return true;
+			};
+			for(unsigned int v : neighbours[u]){
+				if(endDepot[v]){
+					for(unsigned int B = 0; B < routes.size(); B++)
+						if(endsOf(B).end == v && tryCut(B, routes[B].size()))
+							return true;
+					continue;
+				}
+				for(auto &st : stops[v])
+					if(tryCut(st.first, st.second))
+						return true;
+			}
+			if(expired)
+				return false;
+		}
+	}
+	return false;
+}
+
+/*
+ * Improves the routes until no move helps, maxMoves moves were applied or
+ * maxMillis milliseconds passed (0: no limit).
+ */
+template<class T>
+LocalSearchStats LocalSearch<T>::run(unsigned int maxMoves, double maxMillis){
+	this->maxMoves = maxMoves;
+	this->maxMillis = maxMillis;
+	start = Clock::now();
+	expired = false;
+	stats = LocalSearchStats();
+	stats.initialCost = objective(fleet);
+
+	unsigned int n = d.size();
+	firstStop.assign(n, -1);
+	lastStop.assign(n, -1);
+	stops.assign(n, vector<pair<unsigned int, unsigned int>>());
+	endDepot.assign(n, false);
+	for(unsigned int b = 0; b < routes.size(); b++)
+		endDepot[endsOf(b).end] = true;
+	buildNeighbours();
+
+	constrained = false;
+	for(unsigned int r = 0; r < requests.size(); r++)
+		if(!constraints[r].unconstrained())
+			constrained = true;
+	for(double c : capacity)
+		if(c != INF)
+			constrained = true;
+	for(const RouteProfile &p : profiles)
+		if(p.timed())
+			constrained = true;
+
+	pickupPos.assign(requests.size(), -1);
+	deliveryPos.assign(requests.size(), -1);
+	active.assign(requests.size(), true);
+	state.assign(routes.size(), RouteState());
+	for(unsigned int r = 0; r < requests.size(); r++)
+		if(owner[r] != -1)
+			state[owner[r]].requests.push_back(r);
+		else
+			active[r] = false;
+	for(unsigned int b = 0; b < routes.size(); b++){
+		rebuild(b);
+		for(unsigned int r : state[b].requests)
+			active[r] = pickupPos[r] != -1 && pickupPos[r] < deliveryPos[r];
+		rebuild(b);
+	}
+	lengths.assign(routes.size(), 0);
+	for(unsigned int b = 0; b < routes.size(); b++){
+		RouteEnds e = endsOf(b);
+		lengths[b] = routes[b].empty() ? d.get(e.start, e.end) : state[b].pre.back() + d.get(routes[b].back(), e.end);
+	}
+	rebuildStops();
+
+	bool improved = true;
+	while(improved && !expired && (maxMoves == 0 || stats.applied() < maxMoves)){
+		improved = false;
+		for(unsigned int b = 0; b < routes.size(); b++){
+			while(!expired && (maxMoves == 0 || stats.applied() < maxMoves)){
+				if(orOpt(b))
+					stats.orOpt++;
+				else if(exchange(b))
+					stats.exchange++;
+				else if(twoOpt(b))
+					stats.twoOpt++;
+				else
+					break;
+				commit(b);
+				rebuildStops();
+				improved = true;
+				if(onImprove)
+					onImprove();
+			}
+		}
+		while(!expired && (maxMoves == 0 || stats.applied() < maxMoves)){
+			if(relocateRequest())
+				stats.relocateRequest++;
+			else if(exchangeRequests())
+				stats.exchangeRequests++;
+			else if(twoOptStar())
+				stats.twoOptStar++;
+			else
+				break;
+			rebuildStops();
+			improved = true;
+			if(onImprove)
+				onImprove();
+		}
+	}
+
+	stats.finalCost = objective(fleet);
+	stats.millis = chrono::duration<double, milli>(Clock::now() - start).count();
+	return stats;
+}
+
+#endif /* SRC_LOCALSEARCH_H_ */
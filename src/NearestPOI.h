@@ -0,0 +1,138 @@
+/*
+ * NearestPOI.h
+ * Nearest point of interest labelling. For a tag (e.g. "amenity=bank") every
+ * vertex of the map is labelled with its closest tagged vertex and the
+ * distance to it, using a single multi-source Dijkstra over the reversed
+ * edges. Labels are computed once per map, tag index and tag and then
+ * answered in O(1). The cache holds on to the address of the map: call
+ * invalidate() before a map is changed, moved or destroyed, or an unrelated
+ * map later built at the same address may be answered from stale labels.
+ */
+
+#ifndef SRC_NEARESTPOI_H_
+#define SRC_NEARESTPOI_H_
+
+#include <map>
+
+#include "Graph.h"
+#include "TagIndex.h"
+
+/*
+ * Labels of one tag on one map, indexed by dense vertex index.
+ * nearest[i] is the index of the closest POI (-1 if none reaches i).
+ */
+struct POILabels {
+  vector<int> nearest;
+  vector<float> dist;
+};
+
+template <class T> class NearestPOI {
+  // labels of a map and tag index, each with the stamps of the index and
+  // map it was computed from
+  struct Entry {
+    unsigned long tagStamp = 0, graphStamp = 0;
+    POILabels labels;
+  };
+  typedef pair<const Graph<T> *, const TagIndex<T> *> Key;
+  map<Key, unordered_map<string, Entry>> cache;
+
+public:
+  const POILabels &getLabels(const Graph<T> &graph, const TagIndex<T> &tags,
+                             const string &tag);
+  Vertex<T> *getNearest(const Graph<T> &graph, const TagIndex<T> &tags,
+                        const string &tag, const T &node);
+  double getDistance(const Graph<T> &graph, const TagIndex<T> &tags,
+                     const string &tag, const T &node);
+  void invalidate(const Graph<T> &graph);
+  void invalidate(const TagIndex<T> &tags);
+  void clear();
+};
+
+template <class T>
+const POILabels &NearestPOI<T>::getLabels(const Graph<T> &graph,
+                                          const TagIndex<T> &tags,
+                                          const string &tag) {
+  unordered_map<string, Entry> &labels = cache[Key(&graph, &tags)];
+  auto it = labels.find(tag);
+  // stale once the index is refilled, a vertex is removed, or another map
+  // is at that address
+  if (it != labels.end() && it->second.tagStamp == tags.getStamp() &&
+      it->second.graphStamp == graph.getStamp() &&
+      it->second.labels.nearest.size() == (size_t)graph.getNumVertex())
+    return it->second.labels;
+
+  vector<double> dist;
+  Entry &e = labels[tag];
+  e.tagStamp = tags.getStamp();
+  e.graphStamp = graph.getStamp();
+  POILabels &l = e.labels;
+  // reverse search: distances are from each vertex to the POI; an index
+  // whose vertex indices are out of date labels nothing
+  graph.dijkstraShortestPath(tags.isCurrent(graph) ? tags.getVertexIndices(tag)
+                                                   : vector<unsigned int>(),
+                             dist, l.nearest, true);
+  l.dist.resize(dist.size());
+  for (size_t i = 0; i < dist.size(); i++)
+    l.dist[i] = dist[i] == INF ? numeric_limits<float>::infinity()
+                               : (float)dist[i];
+  return l;
+}
+
+/*
+ * Returns the closest vertex carrying the tag, or nullptr if the node is not
+ * in the map, no such vertex reaches it, or a vertex was removed from the map
+ * since the tags were read (see TagIndex::isCurrent).
+ */
+template <class T>
+Vertex<T> *NearestPOI<T>::getNearest(const Graph<T> &graph,
+                                     const TagIndex<T> &tags,
+                                     const string &tag, const T &node) {
+  int idx = graph.findVertexIdx(node);
+  if (idx == -1)
+    return nullptr;
+  int poi = getLabels(graph, tags, tag).nearest[idx];
+  if (poi == -1)
+    return nullptr;
+  return graph.getVertex(poi);
+}
+
+template <class T>
+double NearestPOI<T>::getDistance(const Graph<T> &graph,
+                                  const TagIndex<T> &tags, const string &tag,
+                                  const T &node) {
+  int idx = graph.findVertexIdx(node);
+  if (idx == -1)
+    return INF;
+  const POILabels &l = getLabels(graph, tags, tag);
+  if (l.nearest[idx] == -1)
+    return INF;
+  return l.dist[idx];
+}
+
+/*
+ * Must be called when the graph changes (vertices or edges added/removed),
+ * and before it is moved or destroyed.
+ */
+template <class T> void NearestPOI<T>::invalidate(const Graph<T> &graph) {
+  for (auto it = cache.begin(); it != cache.end();)
+    if (it->first.first == &graph)
+      it = cache.erase(it);
+    else
+      ++it;
+}
+
+/*
+ * Must be called before the tag index is moved or destroyed.
+ */
+template <class T>
+void NearestPOI<T>::invalidate(const TagIndex<T> &tags) {
+  for (auto it = cache.begin(); it != cache.end();)
+    if (it->first.second == &tags)
+      it = cache.erase(it);
+    else
+      ++it;
+}
+
+template <class T> void NearestPOI<T>::clear() { cache.clear(); }
+
+#endif /* SRC_NEARESTPOI_H_ */
@@ -0,0 +1,159 @@
+/*
+ * PathTrees.h
+ *
+ * Shortest path trees of the interest points, kept from the searches that
+ * filled the distance matrices, so routes can be expanded to the vertices
+ * they drive through without searching again. A tree is cut down to the
+ * paths from its root to the given targets (the other slots), so it holds
+ * the legs a route may take from there, not every vertex of the map: its
+ * vertices (graph indices, sorted) and the position of each one's
+ * predecessor (-1 at the root). A leg is read back from its end, so it
+ * costs only its number of vertices.
+ */
+
+#ifndef SRC_PATHTREES_H_
+#define SRC_PATHTREES_H_
+
+#include <unordered_map>
+
+#include "Graph.h"
+
+template<class T>
+class PathTrees{
+
+	struct Tree{
+		vector<int> vertex;
+		vector<int> parent;
+	};
+	unordered_map<T, Tree> trees;	// by root
+
+	static void collect(const Tree &tree, vector<pair<int, int>> &edges);
+	static void build(Tree &tree, vector<pair<int, int>> &edges);
+
+public:
+	void clear();
+	void set(const Graph<T> &graph, const T &root, const vector<int> &pred, const vector<int> &targets);
+	void merge(PathTrees<T> &other);
+	bool appendLeg(const Graph<T> &graph, const T &from, const T &to, vector<T> &out) const;
+	size_t size() const;
+};
+
+template<class T>
+void PathTrees<T>::clear(){trees.clear();}
+
+/*
+ * Adds to edges the vertices of tree, each with the graph index of its
+ * predecessor (-1 at the root).
+ */
+template<class T>
+void PathTrees<T>::collect(const Tree &tree, vector<pair<int, int>> &edges){
+	for(size_t k = 0; k < tree.vertex.size(); k++)
+		edges.push_back(make_pair(tree.vertex[k], tree.parent[k] == -1 ? -1 : tree.vertex[tree.parent[k]]));
+}
+
+/*
+ * Makes tree hold the given vertices and predecessors; edges is sorted and
+ * may repeat a vertex.
+ */
+template<class T>
+void PathTrees<T>::build(Tree &tree, vector<pair<int, int>> &edges){
+	sort(edges.begin(), edges.end());
+	edges.erase(unique(edges.begin(), edges.end()), edges.end());
+	tree.vertex.resize(edges.size());
+	tree.parent.resize(edges.size());
+	for(size_t k = 0; k < edges.size(); k++)
+		tree.vertex[k] = edges[k].first;
+	for(size_t k = 0; k < edges.size(); k++)
+		tree.parent[k] = (edges[k].second == -1) ? -1
+				: lower_bound(tree.vertex.begin(), tree.vertex.end(), edges[k].second) - tree.vertex.begin();
+	tree.vertex.shrink_to_fit();
+	tree.parent.shrink_to_fit();
+}
+
+/*
+ * Keeps the paths from root to the targets (graph indices, -1: none) of pred,
+ * as filled by Graph::dijkstraShortestPath from root, along with the legs
+ * already kept from root.
+ */
+template<class T>
+void PathTrees<T>::set(const Graph<T> &graph, const T &root, const vector<int> &pred, const vector<int> &targets){
+	int r = graph.findVertexIdx(root);
+	if(r == -1)
+		return;
+	Tree &tree = trees[root];
+	vector<bool> kept(pred.size(), false);
+	vector<pair<int, int>> edges;
+	collect(tree, edges);
+	for(auto &e : edges)
+		kept[e.first] = true;
+	if(!kept[r]){
+		kept[r] = true;
+		edges.push_back(make_pair(r, -1));
+	}
+	for(int t : targets){
+		if(t == -1 || (pred[t] == -1 && t != r))
+			continue;
+		for(int v = t; !kept[v]; v = pred[v]){
+			kept[v] = true;
+			edges.push_back(make_pair(v, pred[v]));
+		}
+	}
+	build(tree, edges);
+}
+
+/*
+ * Moves in the trees of other; the legs of a root kept in both are joined (a
+ * search from the same root gives the same tree).
+ */
+template<class T>
+void PathTrees<T>::merge(PathTrees<T> &other){
+	vector<pair<int, int>> edges;
+	for(auto &tree : other.trees){
+		auto here = trees.find(tree.first);
+		if(here == trees.end()){
+			trees[tree.first] = std::move(tree.second);
+			continue;
+		}
+		edges.clear();
+		collect(here->second, edges);
+		collect(tree.second, edges);
+		build(here->second, edges);
+	}
+	other.clear();
+}
+
+/*
+ * Appends the vertices after from on its shortest path to to. False, with
+ * nothing appended, if there is no tree of from or it does not hold to.
+ */
+template<class T>
+bool PathTrees<T>::appendLeg(const Graph<T> &graph, const T &from, const T &to, vector<T> &out) const{
+	auto tree = trees.find(from);
+	int target = graph.findVertexIdx(to);
+	if(tree == trees.end() || target == -1)
+		return false;
+	if(target == graph.findVertexIdx(from))
+		return true;
+	const vector<int> &vertex = tree->second.vertex, &parent = tree->second.parent;
+	auto it = lower_bound(vertex.begin(), vertex.end(), target);
+	if(it == vertex.end() || *it != target)
+		return false;
+	size_t begin = out.size();
+	for(int k = it - vertex.begin(); parent[k] != -1; k = parent[k])
+		out.push_back(graph.getVertex(vertex[k])->getInfo());
+	reverse(out.begin() + begin, out.end());
+	return true;
+}
+
+/*
+ * Vertices kept, over all trees.
+ */
+template<class T>
+size_t PathTrees<T>::size() const{
+	size_t n = 0;
+	for(auto &tree : trees)
+		n += tree.second.vertex.size();
+	return n;
+}
+
+#endif /* SRC_PATHTREES_H_ */
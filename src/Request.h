@@ -17,6 +17,10 @@ class Request{
 	T fim;
 	string especialidade;
 	bool valid = true;
+	int vehicle = -1;	// in the DeliverySystem's vehicles, of the route serving it
+	double load = 0;
+	double pickupEarliest = 0, pickupLatest = INF;		// start of service
+	double deliveryEarliest = 0, deliveryLatest = INF;
 
 public:
 	Request(T inicio , T fim, string especialidade);
@@ -25,6 +29,17 @@ public:
 	string getEspecialidade() const;
 	bool isValid()const;
 	void setValid(bool v);
+	int getVehicle() const;
+	void setVehicle(int v);
+
+	double getLoad() const;
+	void setLoad(double l);
+	double getPickupEarliest() const;
+	double getPickupLatest() const;
+	void setPickupWindow(double earliest, double latest);
+	double getDeliveryEarliest() const;
+	double getDeliveryLatest() const;
+	void setDeliveryWindow(double earliest, double latest);
 
 };
 
@@ -46,6 +61,44 @@ bool Request<T>::isValid()const{ return valid;}
 template<class T>
 void Request<T>::setValid(bool v){valid = v;}
 
+/*
+ * Vehicle whose route serves the request since the last run or dispatch, -1
+ * if none does.
+ */
+template<class T>
+int Request<T>::getVehicle() const{return vehicle;}
+template<class T>
+void Request<T>::setVehicle(int v){vehicle = v;}
+
+template<class T>
+double Request<T>::getLoad() const{return load;}
+template<class T>
+void Request<T>::setLoad(double l){load = l;}
+
+/*
+ * Times are in the units of the edge weights, from the vehicles leaving the
+ * origin.
+ */
+template<class T>
+double Request<T>::getPickupEarliest() const{return pickupEarliest;}
+template<class T>
+double Request<T>::getPickupLatest() const{return pickupLatest;}
+template<class T>
+void Request<T>::setPickupWindow(double earliest, double latest){
+	pickupEarliest = earliest;
+	pickupLatest = latest;
+}
+
+template<class T>
+double Request<T>::getDeliveryEarliest() const{return deliveryEarliest;}
+template<class T>
+double Request<T>::getDeliveryLatest() const{return deliveryLatest;}
+template<class T>
+void Request<T>::setDeliveryWindow(double earliest, double latest){
+	deliveryEarliest = earliest;
+	deliveryLatest = latest;
+}
+
 
 
 #endif /* SRC_REQUEST_H_ */
\ No newline at end of file
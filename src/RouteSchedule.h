@@ -0,0 +1,491 @@
+/*
+ * RouteSchedule.h
+ *
+ * Load and time window feasibility of a route. A request may carry a load
+ * and a window for the start of service at each of its two stops, and a
+ * route may have a capacity and a longest duration. Travel times are the
+ * matrix distances times the pace of the route's vehicle: it leaves its
+ * depot at time 0, service takes no time, a vehicle that arrives early waits
+ * for the window to open, and it must be back at its end depot by the
+ * longest duration.
+ *
+ * build() simulates a route once and keeps, per stop, the load after it, the
+ * start of service and the forward time slack (how much later the vehicle
+ * may arrive there without breaking a window further on). An insertion is
+ * then checked in O(1) per candidate place instead of simulating the route
+ * again. FleetSchedule keeps one per route for the insertion heuristics,
+ * along with where each request rides (see RouteIndex).
+ */
+
+#ifndef SRC_ROUTESCHEDULE_H_
+#define SRC_ROUTESCHEDULE_H_
+
+#include "DistanceMatrix.h"
+
+struct RequestConstraint{
+	double load = 0;
+	double pickupEarliest = 0, pickupLatest = INF;
+	double deliveryEarliest = 0, deliveryLatest = INF;
+
+	bool unconstrained() const{
+		return load == 0 && pickupEarliest <= 0 && pickupLatest == INF
+				&& deliveryEarliest <= 0 && deliveryLatest == INF;
+	}
+};
+
+/*
+ * The vehicle of a route, beyond its capacity and depots: the time it takes
+ * per unit of matrix distance (1 / its speed), how long its route may last,
+ * and what the route costs: a fixed cost once it has stops, plus a cost per
+ * unit of distance. The default costs a route its length, so the fleet
+ * objectives add up lengths.
+ */
+struct RouteProfile{
+	double pace = 1;
+	double maxDuration = INF;
+	double fixedCost = 0;
+	double distanceCost = 1;
+
+	bool timed() const{return maxDuration != INF;}
+	bool plain() const{
+		return pace == 1 && !timed() && fixedCost == 0 && distanceCost == 1;
+	}
+	//of a route of the given length, used if it has stops
+	double cost(double length, bool used) const{
+		return length >= INF ? INF : (used ? fixedCost : 0) + distanceCost * length;
+	}
+	//of a route that cost cost, after added more length and getting stops
+	double grown(double cost, double added, bool wasUsed) const{
+		return (cost >= INF || added >= INF) ? INF : cost + distanceCost * added + (wasUsed ? 0 : fixedCost);
+	}
+};
+
+/*
+ * Stops of the requests of a route, matched as everywhere: to the first stop
+ * of the pickup and the last stop of the delivery. Per stop, whether some
+ * request is picked up there and the latest pickup of the requests delivered
+ * there (-1: none), so how far forward a delivery stop may move is known in
+ * O(1).
+ */
+struct RouteIndex{
+	vector<bool> pickup;
+	vector<int> latestPickup;
+};
+
+/*
+ * Buffers build() reuses from one route to the next, one set per thread (see
+ * scheduleScratch()): once they have grown to the largest matrix and route,
+ * scheduling a route allocates nothing beyond its own per-stop vectors, which
+ * it keeps from build to build.
+ */
+struct ScheduleScratch{
+	vector<int> firstStop, lastStop;	// per slot, -1 between builds
+	vector<double> change;				// per stop, load picked up minus delivered
+};
+
+inline ScheduleScratch & scheduleScratch(){
+	static thread_local ScheduleScratch scratch;
+	return scratch;
+}
+
+/*
+ * Room for n elements in v, doubling it as resize() would: assign() and
+ * copies only make room for exactly n, so a route growing by a stop or two
+ * per build would get new buffers every time.
+ */
+template<class V>
+inline void reserveGrowing(vector<V> &v, size_t n){
+	if(n > v.capacity())
+		v.reserve(std::max(n, 2 * v.capacity()));
+}
+
+template<class T>
+class RouteSchedule{
+
+	const DistanceMatrix<T> *d = nullptr;
+	const vector<pair<unsigned int, unsigned int>> *requests = nullptr;	// pickup and delivery slots
+	const vector<RequestConstraint> *constraints = nullptr;
+	vector<unsigned int> served;
+	double capacity = INF;
+	RouteEnds ends;
+	RouteProfile profile;
+
+	vector<double> load;				// per stop, on board after it
+	vector<double> arrive, begin;		// per stop, arrival and start of service
+	vector<double> earliest, latest;	// per stop, window of the requests matched to it
+	vector<double> slack;				// per stop, then for the return to the depot
+	double arriveEnd = 0;				// back at the end depot
+	bool ok = true;
+
+	bool fits(size_t k, double arrival) const;
+
+public:
+	void build(const DistanceMatrix<T> &d, const vector<unsigned int> &route, const vector<pair<unsigned int, unsigned int>> &requests,
+			const vector<RequestConstraint> &constraints, const vector<unsigned int> &served, double capacity, const RouteEnds &ends = RouteEnds(),
+			const RouteProfile &profile = RouteProfile());
+	bool feasible() const;
+	double cheapestInsertion(const vector<unsigned int> &route, unsigned int r, size_t &bestA, size_t &bestI) const;
+};
+
+/*
+ * Schedules of the routes of a fleet, as requests are inserted one at a
+ * time. Inactive, and never consulted, unless some request or route is
+ * constrained. The RouteIndex of every route is kept either way.
+ */
+template<class T>
+class FleetSchedule{
+
+	const DistanceMatrix<T> &d;
+	const vector<pair<unsigned int, unsigned int>> &requests;	// pickup and delivery slots
+	vector<RequestConstraint> constraints;
+	vector<double> capacity;				// per route
+	vector<RouteEnds> ends;					// per route, empty: all at the origin
+	vector<RouteProfile> profiles;			// per route, empty: all plain
+	vector<vector<unsigned int>> served;	// per route
+	vector<RouteSchedule<T>> schedules;
+	bool on = false;
+
+	vector<RouteIndex> indices;				// per route
+	vector<int> firstStop, lastStop;		// scratch, per slot
+
+	void index(unsigned int b, const vector<unsigned int> &route);
+
+public:
+	FleetSchedule(const DistanceMatrix<T> &d, const vector<pair<unsigned int, unsigned int>> &requests,
+			const vector<RequestConstraint> &constraints, const vector<double> &capacity, const vector<RouteEnds> &ends = vector<RouteEnds>(),
+			const vector<RouteProfile> &profiles = vector<RouteProfile>());
+
+	bool active() const;
+	const RequestConstraint & getConstraint(unsigned int r) const;
+	RouteEnds getEnds(unsigned int b) const;
+	RouteProfile getProfile(unsigned int b) const;
+	void reset(const vector<vector<unsigned int>> &routes, const vector<int> &owner);
+	void assign(unsigned int r, unsigned int b, const vector<unsigned int> &route);
+	double cheapestInsertion(unsigned int b, const vector<unsigned int> &route, unsigned int r, size_t &bestA, size_t &bestI) const;
+	const RouteIndex & getIndex(unsigned int b) const;
+};
+
+/*
+ * Simulates a route serving the given requests (indices into requests and
+ * constraints), each matched to the first stop of its pickup and the last
+ * stop of its delivery, as elsewhere, leaving from and returning to the given
+ * ends at the pace of the given profile. The vectors must outlive the
+ * schedule.
+ */
+template<class T>
+void RouteSchedule<T>::build(const DistanceMatrix<T> &d, const vector<unsigned int> &route, const vector<pair<unsigned int, unsigned int>> &requests,
+		const vector<RequestConstraint> &constraints, const vector<unsigned int> &served, double capacity, const RouteEnds &ends,
+		const RouteProfile &profile){
+	this->d = &d;
+	this->requests = &requests;
+	this->constraints = &constraints;
+	reserveGrowing(this->served, served.size());
+	this->served = served;
+	this->capacity = capacity;
+	this->ends = ends;
+	this->profile = profile;
+	ScaledMatrix<T> t(d, profile.pace);
+
+	int L = route.size();
+	ScheduleScratch &scratch = scheduleScratch();
+	vector<int> &first = scratch.firstStop, &last = scratch.lastStop;
+	if(first.size() < d.size()){
+		first.resize(d.size(), -1);
+		last.resize(d.size(), -1);
+	}
+	for(int p = L - 1; p >= 0; p--)
+		first[route[p]] = p;
+	for(int p = 0; p < L; p++)
+		last[route[p]] = p;
+
+	vector<double> &change = scratch.change;
+	reserveGrowing(change, L);
+	reserveGrowing(earliest, L);
+	reserveGrowing(latest, L);
+	change.assign(L, 0);
+	earliest.assign(L, 0);
+	latest.assign(L, INF);
+	for(unsigned int r : served){
+		int pp = first[requests[r].first], dp = last[requests[r].second];
+		if(pp == -1 || dp == -1 || pp > dp)
+			continue;
+		const RequestConstraint &c = constraints[r];
+		change[pp] += c.load;
+		change[dp] -= c.load;
+		earliest[pp] = std::max(earliest[pp], c.pickupEarliest);
+		latest[pp] = std::min(latest[pp], c.pickupLatest);
+		earliest[dp] = std::max(earliest[dp], c.deliveryEarliest);
+		latest[dp] = std::min(latest[dp], c.deliveryLatest);
+	}
+	for(int p = 0; p < L; p++)
+		first[route[p]] = last[route[p]] = -1;
+
+	load.resize(L);
+	arrive.resize(L);
+	begin.resize(L);
+	ok = true;
+	double time = 0, onBoard = 0;
+	unsigned int prev = ends.start;
+	for(int p = 0; p < L; p++){
+		arrive[p] = time + t.get(prev, route[p]);
+		begin[p] = std::max(arrive[p], earliest[p]);
+		onBoard += change[p];
+		load[p] = onBoard;
+		if(begin[p] > latest[p] || onBoard > capacity)
+			ok = false;
+		time = begin[p];
+		prev = route[p];
+	}
+	arriveEnd = time + t.get(prev, ends.end);
+	if(arriveEnd > profile.maxDuration)
+		ok = false;
+	reserveGrowing(slack, L + 1);
+	slack.assign(L + 1, INF);
+	if(profile.timed())
+		slack[L] = profile.maxDuration - arriveEnd;
+	for(int p = L - 1; p >= 0; p--)
+		slack[p] = (begin[p] - arrive[p]) + std::min(latest[p] - begin[p], slack[p + 1]);
+}
+
+template<class T>
+bool RouteSchedule<T>::feasible() const{return ok;}
+
+/*
+ * Whether arriving at stop k (k = size: back at the end depot) at the given
+ * time keeps every window from there on and the longest duration.
+ */
+template<class T>
+inline bool RouteSchedule<T>::fits(size_t k, double arrival) const{
+	if(k == arrive.size())
+		return arrival <= profile.maxDuration;
+	return arrival - arrive[k] <= slack[k];
+}
+
+/*
+ * Cheapest feasible place for request r (not yet in the route) as the added
+ * length, like DistanceMatrix::cheapestInsertion; INF if there is none.
+ * While the delivery is moved along, the delay the pickup causes is carried
+ * over the stops in between, so every candidate costs O(1).
+ * Slots the route already visits keep the usual matching (first stop of a
+ * pickup, last stop of a delivery) predictable: the pickup only goes before
+ * the first visit of its slot, so the requests picked up there move to it
+ * (right before that visit, at no added length), and the delivery only after
+ * the last visit of its slot, so the requests delivered there ride on to it.
+ * Windows of the stops they leave are still enforced, which may only turn
+ * down a place.
+ */
+template<class T>
+double RouteSchedule<T>::cheapestInsertion(const vector<unsigned int> &route, unsigned int r, size_t &bestA, size_t &bestI) const{
+	double best = INF;
+	if(!ok)
+		return best;
+	const DistanceMatrix<T> &d = *this->d;
+	ScaledMatrix<T> t(d, profile.pace);
+	unsigned int pickup = (*requests)[r].first, delivery = (*requests)[r].second;
+	const RequestConstraint &c = (*constraints)[r];
+	size_t L = route.size();
+
+	int firstPickup = -1, lastDelivery = -1;
+	for(size_t k = 0; k < L; k++){
+		if(route[k] == pickup && firstPickup == -1)
+			firstPickup = k;
+		if(route[k] == delivery)
+			lastDelivery = k;
+	}
+	//load and windows of the requests picked up at firstPickup and of those
+	//delivered at lastDelivery
+	double pickedUp = 0, ride = 0;
+	double pickupEarliest = c.pickupEarliest, pickupLatest = c.pickupLatest;
+	double deliveryEarliest = c.deliveryEarliest, deliveryLatest = c.deliveryLatest;
+	for(unsigned int q : served){
+		const RequestConstraint &o = (*constraints)[q];
+		if(firstPickup != -1 && (*requests)[q].first == pickup){
+			pickedUp += o.load;
+			pickupEarliest = std::max(pickupEarliest, o.pickupEarliest);
+			pickupLatest = std::min(pickupLatest, o.pickupLatest);
+		}
+		if(lastDelivery != -1 && (*requests)[q].second == delivery){
+			ride += o.load;
+			deliveryEarliest = std::max(deliveryEarliest, o.deliveryEarliest);
+			deliveryLatest = std::min(deliveryLatest, o.deliveryLatest);
+		}
+	}
+	//the former may be picked up from stop pickFrom on, the latter ride
+	//through the stops before rideLimit
+	size_t pickFrom = 0, rideLimit = L;
+	for(int k = firstPickup - 1; k >= 0 && pickFrom == 0; k--)
+		if(load[k] + pickedUp > capacity)
+			pickFrom = k + 1;
+	if(lastDelivery != -1)
+		for(size_t k = lastDelivery; k < L && rideLimit == L; k++)
+			if(load[k] + ride > capacity)
+				rideLimit = k;
+	auto riding = [&](size_t k){
+		return ((int)k < firstPickup ? pickedUp : 0) + ((int)k >= lastDelivery ? ride : 0);
+	};
+
+	size_t lastA = (firstPickup == -1) ? L : firstPickup;
+	for(size_t a = pickFrom; a <= lastA && a <= rideLimit; a++){
+		unsigned int prev = (a == 0) ? ends.start : route[a - 1];
+		unsigned int to = (a == L) ? ends.end : route[a];
+		double cp = d.get(prev, pickup) + d.get(pickup, to) - d.get(prev, to);
+		if(cp >= best)
+			continue;
+		double onBoard = ((a == 0) ? 0 : load[a - 1] + ((int)a > lastDelivery ? ride : 0)) + c.load + pickedUp;
+		double startP = std::max(((a == 0) ? 0 : begin[a - 1]) + t.get(prev, pickup), pickupEarliest);
+		if(onBoard > capacity || startP > pickupLatest)
+			continue;
+
+		//delivery right after the pickup
+		double startD = std::max(startP + t.get(pickup, delivery), deliveryEarliest);
+		if((int)a > lastDelivery && startD <= deliveryLatest && fits(a, startD + t.get(delivery, to))){
+			double cost = cp + d.get(pickup, delivery) + d.get(delivery, to) - d.get(pickup, to);
+			if(cost < best){
+				best = cost;
+				bestA = bestI = a;
+			}
+		}
+		if(a == L)
+			continue;
+
+		//delivery after stops a .. i-1, which are late by delay
+		double delay = startP + t.get(pickup, to) - arrive[a];
+		for(size_t i = a + 1; i <= L; i++){
+			size_t k = i - 1;
+			double start = std::max(arrive[k] + delay, earliest[k]);
+			if(load[k] + riding(k) + c.load > capacity || start > latest[k])
+				break;
+			delay = start - begin[k];
+			if((int)i <= lastDelivery)
+				continue;
+			unsigned int from = route[k];
+			unsigned int next = (i == L) ? ends.end : route[i];
+			startD = std::max(start + t.get(from, delivery), deliveryEarliest);
+			if(startD > deliveryLatest)
+				continue;
+			if(!fits(i, startD + t.get(delivery, next)))
+				continue;
+			double cost = cp + d.get(from, delivery) + d.get(delivery, next) - d.get(from, next);
+			if(cost < best){
+				best = cost;
+				bestA = a;
+				bestI = i;
+			}
+		}
+	}
+	return best;
+}
+
+/*
+ * constraints holds one entry per request (or none), capacity, ends and
+ * profiles one per route (or none).
+ */
+template<class T>
+FleetSchedule<T>::FleetSchedule(const DistanceMatrix<T> &d, const vector<pair<unsigned int, unsigned int>> &requests,
+		const vector<RequestConstraint> &constraints, const vector<double> &capacity, const vector<RouteEnds> &ends,
+		const vector<RouteProfile> &profiles)
+	: d(d), requests(requests), constraints(constraints), capacity(capacity), ends(ends), profiles(profiles){
+	this->constraints.resize(requests.size());
+	for(const RequestConstraint &c : this->constraints)
+		if(!c.unconstrained())
+			on = true;
+	for(double c : capacity)
+		if(c != INF)
+			on = true;
+	for(const RouteProfile &p : profiles)
+		if(p.timed())
+			on = true;
+}
+
+template<class T>
+bool FleetSchedule<T>::active() const{return on;}
+
+template<class T>
+const RequestConstraint & FleetSchedule<T>::getConstraint(unsigned int r) const{return constraints[r];}
+
+/*
+ * Depots of route b, known even while inactive.
+ */
+template<class T>
+RouteEnds FleetSchedule<T>::getEnds(unsigned int b) const{
+	return b < ends.size() ? ends[b] : RouteEnds();
+}
+
+/*
+ * Profile of route b, known even while inactive.
+ */
+template<class T>
+RouteProfile FleetSchedule<T>::getProfile(unsigned int b) const{
+	return b < profiles.size() ? profiles[b] : RouteProfile();
+}
+
+/*
+ * Indexes and schedules the given routes, serving the requests they own
+ * (-1: none).
+ */
+template<class T>
+void FleetSchedule<T>::reset(const vector<vector<unsigned int>> &routes, const vector<int> &owner){
+	served.assign(routes.size(), vector<unsigned int>());
+	for(unsigned int r = 0; r < owner.size(); r++)
+		if(owner[r] != -1)
+			served[owner[r]].push_back(r);
+	indices.resize(routes.size());
+	firstStop.assign(d.size(), -1);
+	lastStop.assign(d.size(), -1);
+	for(unsigned int b = 0; b < routes.size(); b++)
+		index(b, routes[b]);
+	if(!on)
+		return;
+	capacity.resize(routes.size(), INF);
+	schedules.resize(routes.size());
+	for(unsigned int b = 0; b < routes.size(); b++)
+		schedules[b].build(d, routes[b], requests, constraints, served[b], capacity[b], getEnds(b), getProfile(b));
+}
+
+/*
+ * Request r now rides in route b, which became route.
+ */
+template<class T>
+void FleetSchedule<T>::assign(unsigned int r, unsigned int b, const vector<unsigned int> &route){
+	served[b].push_back(r);
+	index(b, route);
+	if(!on)
+		return;
+	schedules[b].build(d, route, requests, constraints, served[b], capacity[b], getEnds(b), getProfile(b));
+}
+
+/*
+ * Matches the requests served by route b to its stops, in O(L + served).
+ */
+template<class T>
+void FleetSchedule<T>::index(unsigned int b, const vector<unsigned int> &route){
+	int L = route.size();
+	for(int p = L - 1; p >= 0; p--)
+		firstStop[route[p]] = p;
+	for(int p = 0; p < L; p++)
+		lastStop[route[p]] = p;
+
+	RouteIndex &index = indices[b];
+	index.pickup.assign(L, false);
+	index.latestPickup.assign(L, -1);
+	for(unsigned int r : served[b]){
+		int pp = firstStop[requests[r].first], dp = lastStop[requests[r].second];
+		if(pp != -1)
+			index.pickup[pp] = true;
+		if(dp != -1)
+			index.latestPickup[dp] = std::max(index.latestPickup[dp], pp);
+	}
+	for(int p = 0; p < L; p++)
+		firstStop[route[p]] = lastStop[route[p]] = -1;
+}
+
+template<class T>
+double FleetSchedule<T>::cheapestInsertion(unsigned int b, const vector<unsigned int> &route, unsigned int r, size_t &bestA, size_t &bestI) const{
+	return schedules[b].cheapestInsertion(route, r, bestA, bestI);
+}
+
+template<class T>
+const RouteIndex & FleetSchedule<T>::getIndex(unsigned int b) const{return indices[b];}
+
+
+#endif /* SRC_ROUTESCHEDULE_H_ */
@@ -0,0 +1,127 @@
+/*
+ * Snapshot.h
+ *
+ * Best routes found so far by a running solve, published for other threads.
+ * Writers (the solver's threads) take turns on a mutex and fill a spare
+ * slot; readers never wait: they pin the current slot with a counter, check
+ * it is still current and copy it. A slot is only written while it is
+ * neither current nor pinned, so a copy is never torn.
+ */
+
+#ifndef SRC_SNAPSHOT_H_
+#define SRC_SNAPSHOT_H_
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+using namespace std;
+
+#define SNAPSHOT_SLOTS 4
+
+template<class T>
+struct SolverSnapshot{
+	vector<vector<T>> paths;	// per vehicle, its stops as in getVehiclesPath
+	vector<double> costs;		// per vehicle, 0 until its specialty has routes
+	double total = 0;
+	double longest = 0;
+	unsigned long version = 0;	// updates published so far, 0: no routes yet
+	double millis = 0;			// since the solve started
+	bool final = false;			// the solve is over, and the vehicles got these routes
+};
+
+template<class T>
+class SnapshotBoard{
+
+	typedef chrono::steady_clock Clock;
+
+	SolverSnapshot<T> staging;		// writers only
+	SolverSnapshot<T> slots[SNAPSHOT_SLOTS];
+	atomic<int> current;			// -1 before the first update
+	mutable atomic<unsigned int> readers[SNAPSHOT_SLOTS];
+	mutex writing;
+	Clock::time_point start;
+
+public:
+	SnapshotBoard();
+
+	void reset(size_t vehicles);
+	void update(const vector<unsigned int> &vehicles, const vector<vector<T>> &paths, const vector<double> &costs, bool final = false);
+	SolverSnapshot<T> read() const;
+};
+
+template<class T>
+SnapshotBoard<T>::SnapshotBoard() : current(-1), start(Clock::now()){
+	for(unsigned int i = 0; i < SNAPSHOT_SLOTS; i++)
+		readers[i] = 0;
+}
+
+/*
+ * Starts over with every vehicle on an empty route and nothing published.
+ * Not to be called while the board is in use.
+ */
+template<class T>
+void SnapshotBoard<T>::reset(size_t vehicles){
+	staging = SolverSnapshot<T>();
+	staging.paths.assign(vehicles, vector<T>());
+	staging.costs.assign(vehicles, 0);
+	current = -1;
+	start = Clock::now();
+}
+
+/*
+ * The given vehicles now have these routes and costs; the others keep
+ * theirs. Safe from any thread. Waits only if a reader has pinned every
+ * spare slot.
+ */
+template<class T>
+void SnapshotBoard<T>::update(const vector<unsigned int> &vehicles, const vector<vector<T>> &paths, const vector<double> &costs, bool final){
+	lock_guard<mutex> lock(writing);
+	for(size_t j = 0; j < vehicles.size(); j++){
+		staging.paths[vehicles[j]] = paths[j];
+		staging.costs[vehicles[j]] = costs[j];
+	}
+	staging.total = staging.longest = 0;
+	for(double c : staging.costs){
+		staging.total += c;
+		staging.longest = max(staging.longest, c);
+	}
+	staging.version++;
+	staging.millis = chrono::duration<double, milli>(Clock::now() - start).count();
+	staging.final = final;
+
+	int c = current.load();
+	for(;;){
+		for(int i = 0; i < SNAPSHOT_SLOTS; i++)
+			if(i != c && readers[i].load() == 0){
+				slots[i] = staging;
+				current = i;
+				return;
+			}
+		this_thread::yield();
+	}
+}
+
+/*
+ * Copy of the latest update (version 0 if there was none yet). Lock-free:
+ * it only starts over if an update was published while pinning.
+ */
+template<class T>
+SolverSnapshot<T> SnapshotBoard<T>::read() const{
+	for(;;){
+		int i = current.load();
+		if(i == -1)
+			return SolverSnapshot<T>();
+		readers[i]++;
+		if(current.load() == i){
+			SolverSnapshot<T> s = slots[i];
+			readers[i]--;
+			return s;
+		}
+		readers[i]--;
+	}
+}
+
+#endif /* SRC_SNAPSHOT_H_ */
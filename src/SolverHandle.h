@@ -0,0 +1,157 @@
+/*
+ * SolverHandle.h
+ *
+ * Runs runEspecialidades() of a DeliverySystem in the background within a
+ * wall-clock budget. Any thread may poll it, cancel it or read the best
+ * routes found so far (see SnapshotBoard) at any moment; the first ones come
+ * once the greedy insertion is done, then after every improvement of ruin
+ * and recreate and at most every SNAPSHOT_MIN_MILLIS during the local
+ * search. Once the budget is spent or the run is cancelled, the improvement
+ * phases stop within a few moves and keep their best routes; the matrices
+ * and the greedy insertion are never cut short, so no request is dropped.
+ * A budget only pays off with an improvement phase that would run past it,
+ * e.g. setLNS(0, maxMillis).
+ */
+
+#ifndef SRC_SOLVERHANDLE_H_
+#define SRC_SOLVERHANDLE_H_
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "DeliverySystem.h"
+#include "Snapshot.h"
+
+template<class T>
+class SolverHandle{
+
+	typedef chrono::steady_clock Clock;
+
+	DeliverySystem<T> &system;
+	double maxMillis;
+	Clock::time_point start;
+	SnapshotBoard<T> board;
+	atomic<bool> stop, finished;
+	mutex lock;
+	condition_variable changed;
+	thread solver, timer;
+
+	void solve();
+	void watch();
+
+public:
+	SolverHandle(DeliverySystem<T> &system, double maxMillis);
+	~SolverHandle();
+	SolverHandle(const SolverHandle &) = delete;
+	SolverHandle & operator=(const SolverHandle &) = delete;
+
+	bool done() const;
+	void cancel();
+	void wait();
+	double getElapsedMillis() const;
+	SolverSnapshot<T> getBest() const;
+};
+
+/*
+ * Starts solving right away, for at most maxMillis milliseconds (0: until
+ * the run ends or is cancelled). system must not be used until done(); its
+ * vehicles then hold the routes of the final snapshot.
+ */
+template<class T>
+SolverHandle<T>::SolverHandle(DeliverySystem<T> &system, double maxMillis)
+	: system(system), maxMillis(maxMillis), start(Clock::now()), stop(false), finished(false){
+	board.reset(system.vehicles.size());
+	solver = thread(&SolverHandle<T>::solve, this);
+	timer = thread(&SolverHandle<T>::watch, this);
+}
+
+/*
+ * Cancels the run and waits for it to end.
+ */
+template<class T>
+SolverHandle<T>::~SolverHandle(){
+	cancel();
+	solver.join();
+	timer.join();
+}
+
+template<class T>
+void SolverHandle<T>::solve(){
+	system.stopFlag = &stop;
+	system.board = &board;
+	system.solveEspecialidades();
+	system.stopFlag = nullptr;
+	system.board = nullptr;
+
+	vector<unsigned int> all;
+	vector<vector<T>> paths;
+	vector<double> costs;
+	for(unsigned int b = 0; b < system.vehicles.size(); b++){
+		all.push_back(b);
+		paths.push_back(system.vehicles[b].getPath());
+		costs.push_back(system.vehicles[b].getRouteCost());
+	}
+	board.update(all, paths, costs, true);
+	{
+		lock_guard<mutex> guard(lock);
+		finished = true;
+	}
+	changed.notify_all();
+}
+
+/*
+ * Raises stop at the deadline, unless the run ends or is cancelled first.
+ */
+template<class T>
+void SolverHandle<T>::watch(){
+	unique_lock<mutex> guard(lock);
+	auto over = [this](){return finished.load() || stop.load();};
+	if(maxMillis > 0)
+		changed.wait_until(guard, start + chrono::duration_cast<Clock::duration>(chrono::duration<double, milli>(maxMillis)), over);
+	else
+		changed.wait(guard, over);
+	stop = true;
+}
+
+/*
+ * Whether the run is over and the final snapshot published.
+ */
+template<class T>
+bool SolverHandle<T>::done() const{return finished.load();}
+
+/*
+ * Ends the run early, as if the budget was spent; returns straight away.
+ */
+template<class T>
+void SolverHandle<T>::cancel(){
+	{
+		lock_guard<mutex> guard(lock);
+		stop = true;
+	}
+	changed.notify_all();
+}
+
+/*
+ * Blocks until done().
+ */
+template<class T>
+void SolverHandle<T>::wait(){
+	unique_lock<mutex> guard(lock);
+	changed.wait(guard, [this](){return finished.load();});
+}
+
+template<class T>
+double SolverHandle<T>::getElapsedMillis() const{
+	return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+/*
+ * The best routes so far, without waiting on the solver.
+ */
+template<class T>
+SolverSnapshot<T> SolverHandle<T>::getBest() const{return board.read();}
+
+#endif /* SRC_SOLVERHANDLE_H_ */
@@ -0,0 +1,246 @@
+/*
+ * SpatialIndex.h
+ * Uniform grid over the vertex coordinates of a map, used to snap arbitrary
+ * coordinates to the road graph (nearest, k-nearest and radius queries).
+ * The grid is built in bulk with a counting sort, so cells are contiguous
+ * ranges of one array (no per-cell allocations).
+ */
+
+#ifndef SRC_SPATIALINDEX_H_
+#define SRC_SPATIALINDEX_H_
+
+#include "Graph.h"
+
+#define SPATIAL_POINTS_PER_CELL 2
+#define EARTH_RADIUS 6371000.0
+#define DEG_TO_RAD (3.14159265358979323846 / 180)
+
+template <class T> class SpatialIndex {
+
+  struct Item {
+    double x, y;
+    Vertex<T> *vertex;
+  };
+
+  double minX = 0, minY = 0, cellSize = 1;
+  int cols = 0, rows = 0;
+  double scaleX = 1, scaleY = 1; // coordinates -> metres
+  vector<unsigned int> cellStart; // items of cell c: [cellStart[c], cellStart[c+1])
+  vector<Item> items;
+
+  void build(vector<Item> &points);
+  int cellX(double x) const;
+  int cellY(double y) const;
+  double distToBlockBorder(double x, double y, int cx, int cy, int r) const;
+  template <class F> void visitRing(int cx, int cy, int r, F f) const;
+
+public:
+  void build(const Graph<T> &graph);
+  void build(const Graph<T> &graph, const vector<double> &lat,
+             const vector<double> &lon);
+
+  Vertex<T> *nearest(double x, double y) const;
+  vector<Vertex<T> *> kNearest(double x, double y, unsigned int k) const;
+  vector<Vertex<T> *> radius(double x, double y, double r) const;
+
+  bool empty() const;
+};
+
+/*
+ * Builds the index over the X/Y coordinates of the vertices that have one.
+ */
+template <class T> void SpatialIndex<T>::build(const Graph<T> &graph) {
+  vector<Item> points;
+  vector<Vertex<T> *> v = graph.getVertexSet();
+  points.reserve(v.size());
+  for (unsigned int i = 0; i < v.size(); i++)
+    if (v[i]->hasPosition())
+      points.push_back(Item{v[i]->getX(), v[i]->getY(), v[i]});
+  scaleX = scaleY = 1;
+  build(points);
+}
+
+/*
+ * Builds the index over latitude/longitude (degrees), indexed by dense vertex
+ * index (see readLatLonFromFile). Vertices whose coordinates are NaN (not in
+ * the file) are left out. Coordinates are projected with an equirectangular
+ * approximation, which is accurate at city scale, so query radii are in
+ * metres. Queries then take x = longitude and y = latitude.
+ */
+template <class T>
+void SpatialIndex<T>::build(const Graph<T> &graph, const vector<double> &lat,
+                            const vector<double> &lon) {
+  vector<Item> points;
+  points.reserve(lat.size());
+  for (unsigned int i = 0; i < lat.size() && i < lon.size(); i++)
+    if (graph.getVertex(i) != nullptr && !std::isnan(lat[i]) &&
+        !std::isnan(lon[i]))
+      points.push_back(Item{lon[i], lat[i], graph.getVertex(i)});
+  double meanLat = 0;
+  for (const Item &p : points)
+    meanLat += p.y / points.size();
+  scaleY = EARTH_RADIUS * DEG_TO_RAD;
+  scaleX = scaleY * cos(meanLat * DEG_TO_RAD);
+  build(points);
+}
+
+template <class T> void SpatialIndex<T>::build(vector<Item> &points) {
+  items.clear();
+  cellStart.clear();
+  cols = rows = 0;
+  if (points.empty())
+    return;
+
+  double maxX, maxY;
+  minX = maxX = points[0].x * scaleX;
+  minY = maxY = points[0].y * scaleY;
+  for (Item &p : points) {
+    p.x *= scaleX;
+    p.y *= scaleY;
+    minX = min(minX, p.x);
+    maxX = max(maxX, p.x);
+    minY = min(minY, p.y);
+    maxY = max(maxY, p.y);
+  }
+  double area = max(maxX - minX, 1.0) * max(maxY - minY, 1.0);
+  cellSize = sqrt(area * SPATIAL_POINTS_PER_CELL / points.size());
+  cols = (int)((maxX - minX) / cellSize) + 1;
+  rows = (int)((maxY - minY) / cellSize) + 1;
+
+  // counting sort of the points by cell
+  cellStart.assign(cols * rows + 1, 0);
+  for (const Item &p : points)
+    cellStart[cellY(p.y) * cols + cellX(p.x) + 1]++;
+  for (unsigned int c = 1; c < cellStart.size(); c++)
+    cellStart[c] += cellStart[c - 1];
+  vector<unsigned int> next(cellStart.begin(), cellStart.end() - 1);
+  items.resize(points.size());
+  for (const Item &p : points)
+    items[next[cellY(p.y) * cols + cellX(p.x)]++] = p;
+}
+
+template <class T> int SpatialIndex<T>::cellX(double x) const {
+  int c = (int)floor((x - minX) / cellSize);
+  return c < 0 ? 0 : (c >= cols ? cols - 1 : c);
+}
+
+template <class T> int SpatialIndex<T>::cellY(double y) const {
+  int c = (int)floor((y - minY) / cellSize);
+  return c < 0 ? 0 : (c >= rows ? rows - 1 : c);
+}
+
+/*
+ * Lower bound on the distance from (x, y) to any point outside the block of
+ * cells within r rings of (cx, cy). Sides lying on the grid border bound
+ * nothing, since there are no points beyond them.
+ */
+template <class T>
+double SpatialIndex<T>::distToBlockBorder(double x, double y, int cx, int cy,
+                                          int r) const {
+  double d = INF;
+  if (cx - r > 0)
+    d = min(d, x - (minX + (cx - r) * cellSize));
+  if (cx + r < cols - 1)
+    d = min(d, minX + (cx + r + 1) * cellSize - x);
+  if (cy - r > 0)
+    d = min(d, y - (minY + (cy - r) * cellSize));
+  if (cy + r < rows - 1)
+    d = min(d, minY + (cy + r + 1) * cellSize - y);
+  return max(d, 0.0);
+}
+
+/*
+ * Calls f on every item of the cells at exactly r rings from (cx, cy).
+ */
+template <class T>
+template <class F>
+void SpatialIndex<T>::visitRing(int cx, int cy, int r, F f) const {
+  for (int j = cy - r; j <= cy + r; j++) {
+    if (j < 0 || j >= rows)
+      continue;
+    bool edgeRow = (j == cy - r || j == cy + r);
+    for (int i = cx - r; i <= cx + r; i += (edgeRow ? 1 : 2 * r)) {
+      if (i >= 0 && i < cols) {
+        unsigned int c = j * cols + i;
+        for (unsigned int a = cellStart[c]; a < cellStart[c + 1]; a++)
+          f(items[a]);
+      }
+      if (r == 0)
+        break;
+    }
+  }
+}
+
+template <class T>
+Vertex<T> *SpatialIndex<T>::nearest(double x, double y) const {
+  vector<Vertex<T> *> v = kNearest(x, y, 1);
+  return v.empty() ? nullptr : v[0];
+}
+
+/*
+ * Returns the k vertices closest to (x, y), closest first. Rings of cells are
+ * visited outwards until the k-th best is closer than any unvisited cell.
+ */
+template <class T>
+vector<Vertex<T> *> SpatialIndex<T>::kNearest(double x, double y,
+                                              unsigned int k) const {
+  vector<Vertex<T> *> res;
+  if (items.empty() || k == 0)
+    return res;
+  x *= scaleX;
+  y *= scaleY;
+
+  typedef pair<double, Vertex<T> *> Candidate;
+  priority_queue<Candidate> best; // max-heap on squared distance
+  int cx = cellX(x), cy = cellY(y);
+  int maxRing = max(max(cx, cols - 1 - cx), max(cy, rows - 1 - cy));
+  for (int r = 0; r <= maxRing; r++) {
+    visitRing(cx, cy, r, [&](const Item &p) {
+      double d = (p.x - x) * (p.x - x) + (p.y - y) * (p.y - y);
+      if (best.size() < k)
+        best.push(Candidate(d, p.vertex));
+      else if (d < best.top().first) {
+        best.pop();
+        best.push(Candidate(d, p.vertex));
+      }
+    });
+    double border = distToBlockBorder(x, y, cx, cy, r);
+    if (best.size() == k && best.top().first <= border * border)
+      break;
+  }
+  while (!best.empty()) {
+    res.push_back(best.top().second);
+    best.pop();
+  }
+  reverse(res.begin(), res.end());
+  return res;
+}
+
+/*
+ * Returns every vertex within distance r of (x, y), in no particular order.
+ */
+template <class T>
+vector<Vertex<T> *> SpatialIndex<T>::radius(double x, double y,
+                                            double r) const {
+  vector<Vertex<T> *> res;
+  if (items.empty())
+    return res;
+  x *= scaleX;
+  y *= scaleY;
+  int x0 = cellX(x - r), x1 = cellX(x + r);
+  int y0 = cellY(y - r), y1 = cellY(y + r);
+  for (int j = y0; j <= y1; j++)
+    for (unsigned int a = cellStart[j * cols + x0];
+         a < cellStart[j * cols + x1 + 1]; a++) {
+      const Item &p = items[a];
+      if ((p.x - x) * (p.x - x) + (p.y - y) * (p.y - y) <= r * r)
+        res.push_back(p.vertex);
+    }
+  return res;
+}
+
+template <class T> bool SpatialIndex<T>::empty() const {
+  return items.empty();
+}
+
+#endif /* SRC_SPATIALINDEX_H_ */
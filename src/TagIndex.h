@@ -0,0 +1,121 @@
+/*
+ * TagIndex.h
+ * Inverted index from OSM tags (e.g. "amenity=bank") to the vertices of a
+ * loaded map. Each tag keeps a sorted array of dense vertex indices
+ * (see Graph::findVertexIdx), so membership is a binary search and listing
+ * the points of interest of a tag needs no scan over the map.
+ */
+
+#ifndef SRC_TAGINDEX_H_
+#define SRC_TAGINDEX_H_
+
+#include <atomic>
+
+#include "Graph.h"
+
+template <class T> class TagIndex {
+  unordered_map<string, vector<unsigned int>> index;
+  vector<unsigned int> empty;
+  unsigned long stamp = 0;
+  unsigned long graphStamp = 0; // of the map the indices are of, 0: not set
+
+  static unsigned long nextStamp();
+
+public:
+  void setGraph(const Graph<T> &graph);
+  bool isCurrent(const Graph<T> &graph) const;
+  void addTag(const string &tag, vector<unsigned int> vertices);
+  bool hasTag(const string &tag) const;
+  bool isTagged(const string &tag, unsigned int vertexIdx) const;
+  const vector<unsigned int> &getVertexIndices(const string &tag) const;
+  vector<T> getNodes(const string &tag, const Graph<T> &graph) const;
+  vector<string> getTags() const;
+  unsigned long getStamp() const;
+};
+
+template <class T> unsigned long TagIndex<T>::nextStamp() {
+  static atomic<unsigned long> last(0);
+  return ++last;
+}
+
+/*
+ * The vertex indices added are those of the graph as it is now.
+ */
+template <class T> void TagIndex<T>::setGraph(const Graph<T> &graph) {
+  graphStamp = graph.getStamp();
+}
+
+/*
+ * False once a vertex was removed from the graph set with setGraph(), which
+ * gives indices to other vertices, or for another graph; true if none was
+ * set.
+ */
+template <class T>
+bool TagIndex<T>::isCurrent(const Graph<T> &graph) const {
+  return graphStamp == 0 || graphStamp == graph.getStamp();
+}
+
+/*
+ * Adds the vertices of a tag to the index. A tag may appear more than once in
+ * the source files, in which case the vertex lists are merged.
+ */
+template <class T>
+void TagIndex<T>::addTag(const string &tag, vector<unsigned int> vertices) {
+  vector<unsigned int> &v = index[tag];
+  v.insert(v.end(), vertices.begin(), vertices.end());
+  sort(v.begin(), v.end());
+  v.erase(unique(v.begin(), v.end()), v.end());
+  v.shrink_to_fit();
+  stamp = nextStamp();
+}
+
+template <class T> bool TagIndex<T>::hasTag(const string &tag) const {
+  return index.find(tag) != index.end();
+}
+
+template <class T>
+bool TagIndex<T>::isTagged(const string &tag, unsigned int vertexIdx) const {
+  const vector<unsigned int> &v = getVertexIndices(tag);
+  return binary_search(v.begin(), v.end(), vertexIdx);
+}
+
+template <class T>
+const vector<unsigned int> &
+TagIndex<T>::getVertexIndices(const string &tag) const {
+  auto it = index.find(tag);
+  if (it == index.end())
+    return empty;
+  return it->second;
+}
+
+template <class T>
+vector<T> TagIndex<T>::getNodes(const string &tag,
+                                const Graph<T> &graph) const {
+  vector<T> res;
+  if (!isCurrent(graph))
+    return res;
+  const vector<unsigned int> &v = getVertexIndices(tag);
+  res.reserve(v.size());
+  for (unsigned int i = 0; i < v.size(); i++)
+    res.push_back(graph.getVertex(v[i])->getInfo());
+  return res;
+}
+
+template <class T> vector<string> TagIndex<T>::getTags() const {
+  vector<string> res;
+  for (auto it = index.begin(); it != index.end(); ++it)
+    res.push_back(it->first);
+  sort(res.begin(), res.end());
+  return res;
+}
+
+/*
+ * Changes whenever a tag is added, and differs between indices filled
+ * separately (copies share it), so results derived from the index can tell
+ * whether they are still current, e.g. after the tags are reloaded.
+ */
+template <class T> unsigned long TagIndex<T>::getStamp() const {
+  return stamp;
+}
+
+#endif /* SRC_TAGINDEX_H_ */
@@ -0,0 +1,119 @@
+/*
+ * ThreadPool.h
+ *
+ * Fixed set of worker threads running parallel loops. parallelFor hands out
+ * the indices of a loop to the workers and to the calling thread and returns
+ * once all of them are done, so every index is run exactly once and results
+ * written per index do not depend on thread timing.
+ */
+
+#ifndef SRC_THREADPOOL_H_
+#define SRC_THREADPOOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+using namespace std;
+
+class ThreadPool{
+
+	vector<thread> workers;
+	mutex m;
+	condition_variable start, finished;
+
+	const function<void(size_t)> *task = nullptr;
+	size_t count = 0;
+	atomic<size_t> nextIndex;
+	size_t running = 0;			// workers still inside the current loop
+	unsigned long generation = 0;	// bumped for every loop
+	bool stop = false;
+
+	void work();
+	void runTask();
+
+public:
+	ThreadPool(unsigned int numThreads = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool & operator=(const ThreadPool &) = delete;
+
+	size_t size() const;
+	void parallelFor(size_t n, const function<void(size_t)> &f);
+};
+
+/*
+ * numThreads counts the calling thread; 0 means one per core.
+ */
+inline ThreadPool::ThreadPool(unsigned int numThreads) : nextIndex(0){
+	if(numThreads == 0)
+		numThreads = max(thread::hardware_concurrency(), 1u);
+	for(unsigned int i = 1; i < numThreads; i++)
+		workers.push_back(thread(&ThreadPool::work, this));
+}
+
+inline ThreadPool::~ThreadPool(){
+	{
+		lock_guard<mutex> lock(m);
+		stop = true;
+	}
+	start.notify_all();
+	for(thread &t : workers)
+		t.join();
+}
+
+inline size_t ThreadPool::size() const{return workers.size() + 1;}
+
+inline void ThreadPool::runTask(){
+	for(size_t i = nextIndex++; i < count; i = nextIndex++)
+		(*task)(i);
+}
+
+inline void ThreadPool::work(){
+	unsigned long seen = 0;
+	while(true){
+		{
+			unique_lock<mutex> lock(m);
+			start.wait(lock, [&]{return stop || generation != seen;});
+			if(stop)
+				return;
+			seen = generation;
+		}
+		runTask();
+		{
+			lock_guard<mutex> lock(m);
+			running--;
+		}
+		finished.notify_one();
+	}
+}
+
+/*
+ * Runs f(0) ... f(n-1) and waits for all of them. Not reentrant: f must not
+ * call parallelFor on the same pool.
+ */
+inline void ThreadPool::parallelFor(size_t n, const function<void(size_t)> &f){
+	if(workers.empty() || n < 2){
+		for(size_t i = 0; i < n; i++)
+			f(i);
+		return;
+	}
+	{
+		lock_guard<mutex> lock(m);
+		task = &f;
+		count = n;
+		nextIndex = 0;
+		running = workers.size();
+		generation++;
+	}
+	start.notify_all();
+	runTask();
+	unique_lock<mutex> lock(m);
+	finished.wait(lock, [&]{return running == 0;});
+	task = nullptr;
+}
+
+#endif /* SRC_THREADPOOL_H_ */
@@ -16,6 +16,14 @@ class Vehicle{
 	unsigned int totalDistance = 0;
 	Vertex<T> * currentVertex = NULL;
 	vector<T> path;
+	double routeCost = 0;
+	double routeLength = 0;
+	double capacity = INF;
+	double speed = 1;			// matrix distance per unit of time
+	double maxDuration = INF;	// of a route, back at the end depot
+	double fixedCost = 0, distanceCost = 1;	// route cost: fixed if used, plus per distance
+	bool depots = false;	// else it leaves from and returns to the origin
+	T startNode = T(), endNode = T();
 	string specialty;
 
 public:
@@ -26,12 +34,33 @@ public:
 	unsigned int getTotalDistance() const;
 	void setDistance(unsigned int d);
 
-	vector<T> getPath() const;
-	void setPath(vector<T> v);
+	const vector<T> & getPath() const;
+	void setPath(vector<T> &&v);
 	void addToPath(T data);
 
+	double getRouteCost() const;
+	void setRouteCost(double cost);
+	double getRouteLength() const;
+	void setRouteLength(double length);
+
+	double getCapacity() const;
+	void setCapacity(double c);
+
+	double getSpeed() const;
+	void setSpeed(double s);
+	double getMaxDuration() const;
+	void setMaxDuration(double d);
+	double getFixedCost() const;
+	double getDistanceCost() const;
+	void setCosts(double fixed, double perDistance);
+
+	bool hasDepots() const;
+	T getStartNode() const;
+	T getEndNode() const;
+	void setDepots(T start, T end);
+
 	void setSpecialty(string s);
-	string getSpecialty();
+	string getSpecialty() const;
 
 	void reset();
 };
@@ -62,27 +91,105 @@ template<class T>
 unsigned int Vehicle<T>::getTotalDistance() const{return totalDistance;}
 
 template<class T>
-vector<T> Vehicle<T>::getPath() const{return path;}
+const vector<T> & Vehicle<T>::getPath() const{return path;}
 
+/*
+ * Takes over the given route without copying it.
+ */
 template<class T>
-void Vehicle<T>::setPath(vector<T> v){path = v;}
+void Vehicle<T>::setPath(vector<T> &&v){path = move(v);}
 
 template<class T>
 void Vehicle<T>::addToPath(T data){path.push_back(data);}
 
+template<class T>
+double Vehicle<T>::getRouteCost() const{return routeCost;}
+
+template<class T>
+void Vehicle<T>::setRouteCost(double cost){routeCost = cost;}
+
+template<class T>
+double Vehicle<T>::getRouteLength() const{return routeLength;}
+
+template<class T>
+void Vehicle<T>::setRouteLength(double length){routeLength = length;}
+
+template<class T>
+double Vehicle<T>::getCapacity() const{return capacity;}
+
+template<class T>
+void Vehicle<T>::setCapacity(double c){capacity = c;}
+
+template<class T>
+double Vehicle<T>::getSpeed() const{return speed;}
+
+/*
+ * Matrix distance the vehicle covers per unit of time (1 by default), as
+ * request windows and the longest duration are measured.
+ */
+template<class T>
+void Vehicle<T>::setSpeed(double s){speed = s;}
+
+template<class T>
+double Vehicle<T>::getMaxDuration() const{return maxDuration;}
+
+/*
+ * Time by which a route must be back at its end depot (none by default).
+ */
+template<class T>
+void Vehicle<T>::setMaxDuration(double d){maxDuration = d;}
+
+template<class T>
+double Vehicle<T>::getFixedCost() const{return fixedCost;}
+
+template<class T>
+double Vehicle<T>::getDistanceCost() const{return distanceCost;}
+
+/*
+ * A route of the vehicle costs fixed if it serves any request, plus
+ * perDistance per unit of its length (0 and 1 by default: its length).
+ */
+template<class T>
+void Vehicle<T>::setCosts(double fixed, double perDistance){
+	fixedCost = fixed;
+	distanceCost = perDistance;
+}
+
+template<class T>
+bool Vehicle<T>::hasDepots() const{return depots;}
+
+template<class T>
+T Vehicle<T>::getStartNode() const{return startNode;}
+
+template<class T>
+T Vehicle<T>::getEndNode() const{return endNode;}
+
+/*
+ * The vehicle leaves from start and returns to end, instead of the origin of
+ * the system.
+ */
+template<class T>
+void Vehicle<T>::setDepots(T start, T end){
+	depots = true;
+	startNode = start;
+	endNode = end;
+}
+
 template<class T>
 void Vehicle<T>::setSpecialty(string s) {
 	specialty = s;
 }
 
 template<class T>
-string Vehicle<T>::getSpecialty() {return this->specialty;}
+string Vehicle<T>::getSpecialty() const{return this->specialty;}
 
 template<class T>
 void Vehicle<T>::reset(){
 	setDistance(0);
 	setCurrentVertex(NULL);
 	setPath(vector<T>());
+	setRouteCost(0);
+	setRouteLength(0);
 }
 
 template<class T>
@@ -1,3 +1,5 @@
+#include <random>
+
 #include "Graph.h"
 #include "graphviewer.h"
 #include "ui.h"
@@ -162,7 +164,7 @@ void setOriginVertex(DeliverySystem<int> &ds, Graph<int> &graph) {
 }
 
 void loop_main_menu(DeliverySystem<int> &ds, Graph<int> &graph,
-                    GraphViewer *gv) {
+                    SpatialIndex<int> &spatial, GraphViewer *gv) {
   while (true) {
     print_main_menu();
     int option = get_option();
@@ -191,10 +193,10 @@ void loop_main_menu(DeliverySystem<int> &ds, Graph<int> &graph,
       break;
     }
     case 3: {
-      Request<int> request = get_request();
+      Request<int> request = get_request(spatial);
       if (graph.findVertex(request.getInicio()) == nullptr)
         cout << "Origin node not found." << endl;
-      else if (graph.findVertex(request.getInicio()) == nullptr)
+      else if (graph.findVertex(request.getFim()) == nullptr)
         cout << "Destination node not found." << endl;
       else
         ds.addRequest(request);
@@ -206,6 +208,7 @@ void loop_main_menu(DeliverySystem<int> &ds, Graph<int> &graph,
       cin.ignore(999999, '\n');
       string city = get_city();
       graph = readFromFile(city);
+      spatial.build(graph);
       break;
     }
     case 5:
@@ -215,7 +218,8 @@ void loop_main_menu(DeliverySystem<int> &ds, Graph<int> &graph,
   }
 }
 
-void handle_manual_add_menu(DeliverySystem<int> ds, Graph<int> &graph) {
+void handle_manual_add_menu(DeliverySystem<int> ds, Graph<int> &graph,
+                            SpatialIndex<int> &spatial) {
   bool quit = false;
   while (!quit) {
 
@@ -237,18 +241,20 @@ void handle_manual_add_menu(DeliverySystem<int> ds, Graph<int> &graph) {
       if (!graph.addVertex(id, latitude, longitude)) {
         cout << "Vertex already in the graph." << endl;
       }
+      // rebuilt in bulk, the map is small
+      spatial.build(graph);
       break;
     }
     case 2: {
       int id_origin, id_dest;
-      cout << "What is the ID of the origin vertex of the edge? ";
-      cin >> id_origin;
+      cout << "-> Origin vertex of the edge" << endl;
+      id_origin = get_node_info(spatial);
       if ((graph.findVertex(id_origin)) == nullptr) {
         cout << "Error in origin node. Exiting..." << endl;
         break;
       }
-      cout << "What is the ID of the destination vertex of the edge? ";
-      cin >> id_dest;
+      cout << "-> Destination vertex of the edge" << endl;
+      id_dest = get_node_info(spatial);
       if ((graph.findVertex(id_dest)) == nullptr) {
         cout << "Error in destination node. Exiting..." << endl;
         break;
@@ -281,6 +287,7 @@ void user_interface() {
   vector<Vehicle<int>> vehicles;
 
   Graph<int> graph;
+  SpatialIndex<int> spatial;
   DeliverySystem<int> ds(graph, 0);
   GraphViewer *gv = new GraphViewer(600, 600, false, true);
 
@@ -288,7 +295,7 @@ void user_interface() {
   int option = get_option();
   switch (option) {
   case 1: {
-    handle_manual_add_menu(ds, graph);
+    handle_manual_add_menu(ds, graph, spatial);
     setOriginVertex(ds, graph);
     break;
   }
@@ -297,11 +304,12 @@ void user_interface() {
     cin.ignore(999999, '\n');
     string city = get_city();
     graph = readFromFile(city);
+    spatial.build(graph);
 
     break;
   }
   }
-  loop_main_menu(ds, graph, gv);
+  loop_main_menu(ds, graph, spatial, gv);
 }
 
 template<class T>
@@ -315,8 +323,475 @@ void addVehicle(DeliverySystem<T>&ds, string str){
 	cout<< "Added vehicle of type '"<<str<<".\n";
 }
 
+/*
+ * A side x side grid, vertex i * side + j at (i * 10, j * 10), with edges
+ * both ways between neighbours weighing 10 plus a few units drawn from
+ * random. With fractions set each weight also gets a random fraction, so no
+ * two paths are equally short.
+ */
+Graph<int> gridGraph(int side, mt19937 &random, bool fractions = false) {
+  Graph<int> graph;
+  auto weight = [&](unsigned int spread) {
+    double w = 10 + random() % spread;
+    return fractions ? w + random() / (double)random.max() : w;
+  };
+  for (int i = 0; i < side; i++)
+    for (int j = 0; j < side; j++)
+      graph.addVertex(i * side + j, i * 10, j * 10);
+  for (int i = 0; i < side; i++)
+    for (int j = 0; j < side; j++) {
+      if (i + 1 < side) {
+        graph.addEdge(i * side + j, (i + 1) * side + j, weight(7));
+        graph.addEdge((i + 1) * side + j, i * side + j, weight(9));
+      }
+      if (j + 1 < side) {
+        graph.addEdge(i * side + j, i * side + j + 1, weight(5));
+        graph.addEdge(i * side + j + 1, i * side + j, weight(11));
+      }
+    }
+  return graph;
+}
+
+/*
+ * Shortest route from the origin (slot 0) and back serving the given
+ * requests, pickups before deliveries, by trying every order of the stops.
+ */
+double bruteForceRoute(const DistanceMatrix<int> &d,
+                       const vector<pair<int, int>> &requests,
+                       const vector<int> &served) {
+  if (served.empty())
+    return 0;
+  // stop 2r is the pickup of request served[r], 2r + 1 its delivery
+  vector<int> stops;
+  for (unsigned int r = 0; r < served.size(); r++) {
+    stops.push_back(2 * r);
+    stops.push_back(2 * r + 1);
+  }
+  double best = INF;
+  do {
+    vector<bool> picked(served.size(), false);
+    double length = 0;
+    unsigned int prev = 0;
+    bool valid = true;
+    for (int s : stops) {
+      const pair<int, int> &q = requests[served[s / 2]];
+      if (s % 2 == 0)
+        picked[s / 2] = true;
+      else if (!picked[s / 2]) {
+        valid = false;
+        break;
+      }
+      unsigned int slot = d.getSlot(s % 2 == 0 ? q.first : q.second);
+      length += d.get(prev, slot);
+      prev = slot;
+    }
+    if (valid)
+      best = min(best, length + d.get(prev, 0));
+  } while (next_permutation(stops.begin(), stops.end()));
+  return best;
+}
+
+/*
+ * Compares runExact() with every split of the requests among the vehicles
+ * and every order of each route, on small random instances of a grid, under
+ * both fleet objectives. Returns the instances where they disagree.
+ */
+int exactTests(unsigned int instances, unsigned int numRequests,
+               unsigned int numVehicles) {
+  const int side = 8;
+  mt19937 random(1);
+  Graph<int> graph = gridGraph(side, random);
+
+  int mismatches = 0;
+  for (unsigned int k = 0; k < instances; k++) {
+    bool byTime = k % 2;
+    DeliverySystem<int> ds(graph, (side / 2) * side + side / 2);
+    for (unsigned int b = 0; b < numVehicles; b++)
+      ds.addVehicle("exact");
+    vector<pair<int, int>> requests;
+    for (unsigned int r = 0; r < numRequests; r++) {
+      int pickup = random() % (side * side), delivery = random() % (side * side);
+      // some deliveries shared with a pickup, so stops can be merged
+      if (k % 3 == 0 && r > 0)
+        pickup = requests[0].second;
+      requests.push_back(make_pair(pickup, delivery));
+      ds.addRequest(Request<int>(pickup, delivery, "exact"));
+    }
+    if (byTime)
+      ds.setRunByTime();
+    else
+      ds.setRunByVehicles();
+    ds.runExact();
+
+    double best = INF;
+    unsigned int splits = 1;
+    for (unsigned int r = 0; r < numRequests; r++)
+      splits *= numVehicles;
+    for (unsigned int code = 0; code < splits; code++) {
+      vector<vector<int>> parts(numVehicles);
+      for (unsigned int r = 0, c = code; r < numRequests; r++, c /= numVehicles)
+        parts[c % numVehicles].push_back(r);
+      double total = 0, longest = 0;
+      for (const vector<int> &part : parts) {
+        double length = bruteForceRoute(ds.getDistanceMatrix(), requests, part);
+        total += length;
+        longest = max(longest, length);
+      }
+      best = min(best, byTime ? total + longest : total);
+    }
+    if (fabs(best - ds.getExactStats().cost) > 1e-6) {
+      cout << "Exact solver: instance " << k << " gave "
+           << ds.getExactStats().cost << ", brute force " << best << endl;
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+/*
+ * Loads the same cities with readFromFiles and readFromFilesCompact and
+ * compares the vertices, their cities, their edges and the distances from a
+ * few sources. Also checks that a missing city is reported. Returns the
+ * number of differences.
+ */
+int loaderTests(const vector<string> &cities) {
+  Graph<int> graph;
+  CompactGraph<int> compact;
+  vector<unsigned short> partition, compactPartition;
+  int mismatches = 0;
+  if (!readFromFiles(cities, graph, partition) ||
+      !readFromFilesCompact(cities, compact, compactPartition)) {
+    cout << "Loaders: could not read the cities" << endl;
+    return 1;
+  }
+  if ((uint32_t)graph.getNumVertex() != compact.getNumVertex() ||
+      partition != compactPartition) {
+    cout << "Loaders: " << graph.getNumVertex() << " and "
+         << compact.getNumVertex() << " vertices" << endl;
+    return 1;
+  }
+  vector<Vertex<int> *> v = graph.getVertexSet();
+  size_t edges = 0;
+  for (unsigned int i = 0; i < v.size(); i++) {
+    vector<int> dest, compactDest;
+    for (const Edge<int> &e : v[i]->getEdges())
+      dest.push_back(e.dest->getInfo());
+    for (uint32_t e = compact.edgesBegin(i); e < compact.edgesEnd(i); e++)
+      compactDest.push_back(compact.getInfo(compact.getEdgeDest(e)));
+    sort(dest.begin(), dest.end());
+    sort(compactDest.begin(), compactDest.end());
+    edges += dest.size();
+    if (v[i]->getInfo() != compact.getInfo(i) || dest != compactDest)
+      mismatches++;
+  }
+  if (edges != compact.getNumEdges()) {
+    cout << "Loaders: " << edges << " and " << compact.getNumEdges()
+         << " edges" << endl;
+    mismatches++;
+  }
+
+  for (unsigned int s = 0; s < v.size(); s += v.size() / 4) {
+    vector<double> dist;
+    vector<int> nearest;
+    vector<float> compactDist;
+    vector<int32_t> path;
+    graph.dijkstraShortestPath(vector<unsigned int>(1, s), dist, nearest);
+    compact.dijkstraShortestPath(s, compactDist, path);
+    for (unsigned int i = 0; i < v.size(); i++)
+      if (dist[i] == INF ? compactDist[i] != numeric_limits<float>::infinity()
+                         : fabs(dist[i] - compactDist[i]) > 1e-5 * dist[i]) {
+        cout << "Loaders: distance " << dist[i] << " and " << compactDist[i]
+             << endl;
+        mismatches++;
+        break;
+      }
+  }
+
+  Graph<int> partial;
+  vector<string> missing = cities;
+  missing.push_back("Nowhere");
+  if (readFromFiles(missing, partial, partition) ||
+      readFromFilesCompact(missing, compact, compactPartition) ||
+      partial.getNumVertex() != graph.getNumVertex()) {
+    cout << "Loaders: missing city not reported" << endl;
+    mismatches++;
+  }
+  return mismatches;
+}
+
+/*
+ * Requests added to ds (valid ones) that no vehicle serves, or whose vehicle
+ * does not visit the pickup before the delivery.
+ */
+int unservedRequests(DeliverySystem<int> &ds) {
+  vector<Vehicle<int> *> v = ds.getVehicles();
+  int errors = 0;
+  for (const Request<int> &r : ds.getValidRequest()) {
+    if (r.getVehicle() == -1) {
+      errors++;
+      continue;
+    }
+    const vector<int> &path = v[r.getVehicle()]->getPath();
+    auto pickup = find(path.begin(), path.end(), r.getInicio());
+    auto delivery = find(path.rbegin(), path.rend(), r.getFim());
+    if (pickup == path.end() || delivery == path.rend() ||
+        pickup - path.begin() >= path.rend() - delivery - 1)
+      errors++;
+  }
+  return errors;
+}
+
+/*
+ * Sum of the route costs of ds, plus the longest when byTime is set, as the
+ * fleet objectives count them.
+ */
+double fleetObjective(DeliverySystem<int> &ds, bool byTime) {
+  double total = 0, longest = 0;
+  for (Vehicle<int> *v : ds.getVehicles()) {
+    total += v->getRouteCost();
+    longest = max(longest, v->getRouteCost());
+  }
+  return byTime ? total + longest : total;
+}
+
+/*
+ * Runs random instances of a grid greedily, then with the local search and
+ * with ruin and recreate, under both fleet objectives. Counts the searches
+ * that leave a request out or deliver it before its pickup, or that end
+ * worse than they started or than the greedy routes.
+ */
+int searchTests(unsigned int instances, unsigned int numRequests,
+                unsigned int numVehicles) {
+  const int side = 10;
+  mt19937 random(2);
+  Graph<int> graph = gridGraph(side, random);
+
+  int mismatches = 0;
+  for (unsigned int k = 0; k < instances; k++) {
+    bool byTime = k % 2;
+    DeliverySystem<int> plain(graph, (side / 2) * side + side / 2);
+    for (unsigned int b = 0; b < numVehicles; b++)
+      plain.addVehicle("search");
+    for (unsigned int r = 0; r < numRequests; r++) {
+      int pickup = random() % (side * side);
+      int delivery = (pickup + 1 + random() % (side * side - 1)) % (side * side);
+      plain.addRequest(Request<int>(pickup, delivery, "search"));
+    }
+    if (byTime)
+      plain.setRunByTime();
+    else
+      plain.setRunByVehicles();
+    plain.setNumThreads(1);
+    plain.setLocalSearch(0, 0);
+    plain.setLNS(0, 0);
+    DeliverySystem<int> local = plain, lns = plain;
+    local.setLocalSearch(1000, 0);
+    lns.setLNS(200, 0, k);
+    plain.runEspecialidades();
+    local.runEspecialidades();
+    lns.runEspecialidades();
+
+    double greedy = fleetObjective(plain, byTime);
+    double searched[] = {fleetObjective(local, byTime),
+                         fleetObjective(lns, byTime)};
+    double initialCost[] = {local.getLocalSearchStats().initialCost,
+                        lns.getLNSStats().initialCost};
+    double finalCost[] = {local.getLocalSearchStats().finalCost,
+                      lns.getLNSStats().finalCost};
+    int outOfOrder[] = {unservedRequests(local), unservedRequests(lns)};
+    for (int s = 0; s < 2; s++)
+      if (outOfOrder[s] > 0 || finalCost[s] > initialCost[s] + 1e-6 ||
+          searched[s] > greedy + 1e-6) {
+        cout << (s == 0 ? "Local search" : "Ruin and recreate")
+             << ": instance " << k << " gave " << searched[s] << " from "
+             << greedy << ", " << outOfOrder[s] << " requests out of order"
+             << endl;
+        mismatches++;
+      }
+  }
+  return mismatches;
+}
+
+/*
+ * Simulates the routes of ds again from its distance matrix (vehicles at the
+ * origin, speed 1), each request at the first visit of its pickup and the
+ * last of its delivery, and counts the stops served outside their windows or
+ * over the capacity of the vehicle.
+ */
+int scheduleViolations(DeliverySystem<int> &ds, int origin) {
+  const DistanceMatrix<int> &d = ds.getDistanceMatrix();
+  vector<Vehicle<int> *> v = ds.getVehicles();
+  vector<Request<int>> requests = ds.getValidRequest();
+  int violations = 0;
+  for (unsigned int b = 0; b < v.size(); b++) {
+    const vector<int> &path = v[b]->getPath();
+    vector<double> change(path.size(), 0), earliest(path.size(), 0),
+        latest(path.size(), INF);
+    for (const Request<int> &r : requests) {
+      if (r.getVehicle() != (int)b)
+        continue;
+      size_t p = find(path.begin(), path.end(), r.getInicio()) - path.begin();
+      size_t q = path.rend() - find(path.rbegin(), path.rend(), r.getFim()) - 1;
+      if (p >= path.size() || q >= path.size())
+        continue; // counted by unservedRequests
+      change[p] += r.getLoad();
+      change[q] -= r.getLoad();
+      earliest[p] = max(earliest[p], r.getPickupEarliest());
+      latest[p] = min(latest[p], r.getPickupLatest());
+      earliest[q] = max(earliest[q], r.getDeliveryEarliest());
+      latest[q] = min(latest[q], r.getDeliveryLatest());
+    }
+    double time = 0, load = 0;
+    int prev = d.getSlot(origin);
+    for (size_t p = 0; p < path.size(); p++) {
+      time = max(time + d.get(prev, d.getSlot(path[p])), earliest[p]);
+      load += change[p];
+      if (time > latest[p] + 1e-6 || load > v[b]->getCapacity() + 1e-6)
+        violations++;
+      prev = d.getSlot(path[p]);
+    }
+  }
+  return violations;
+}
+
+/*
+ * Random instances of a grid with loads, capacities and time windows, solved
+ * with both searches on. Counts the instances with a served request out of
+ * order or a route breaking a window or a capacity when simulated again.
+ */
+int constraintTests(unsigned int instances, unsigned int numRequests,
+                    unsigned int numVehicles) {
+  const int side = 10, origin = (side / 2) * side + side / 2;
+  mt19937 random(3);
+  Graph<int> graph = gridGraph(side, random);
+
+  int mismatches = 0;
+  for (unsigned int k = 0; k < instances; k++) {
+    DeliverySystem<int> ds(graph, origin);
+    for (unsigned int b = 0; b < numVehicles; b++) {
+      Vehicle<int> vehicle("windows");
+      vehicle.setCapacity(5 + random() % 6);
+      ds.addVehicle(vehicle);
+    }
+    for (unsigned int r = 0; r < numRequests; r++) {
+      int pickup = random() % (side * side);
+      int delivery = (pickup + 1 + random() % (side * side - 1)) % (side * side);
+      Request<int> request(pickup, delivery, "windows");
+      request.setLoad(1 + random() % 4);
+      double open = random() % 600;
+      request.setPickupWindow(open, open + 300 + random() % 300);
+      request.setDeliveryWindow(0, open + 600 + random() % 600);
+      ds.addRequest(request);
+    }
+    if (k % 2)
+      ds.setInsertionByRegret(3);
+    ds.setNumThreads(1);
+    ds.setLocalSearch(1000, 0);
+    ds.setLNS(100, 0, k);
+    ds.runEspecialidades();
+
+    int unserved = 0;
+    for (const Request<int> &r : ds.getValidRequest())
+      if (r.getVehicle() == -1)
+        unserved++;
+    int violations = scheduleViolations(ds, origin);
+    if (unservedRequests(ds) > unserved || violations > 0) {
+      cout << "Constraints: instance " << k << " has " << violations
+           << " stops out of their windows or over capacity" << endl;
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+/*
+ * Stops of the expanded routes of ds that differ from the shortest paths
+ * getPathV finds between their interest points in graph.
+ */
+int pathDifferences(DeliverySystem<int> &ds, Graph<int> &graph, int origin) {
+  vector<vector<int>> expanded = ds.getVehiclesCompletePath();
+  vector<Vehicle<int> *> v = ds.getVehicles();
+  int differences = 0;
+  for (unsigned int b = 0; b < v.size(); b++) {
+    vector<int> stops = v[b]->getPath(), expected(1, origin);
+    stops.push_back(origin);
+    for (unsigned int k = 0; k < stops.size(); k++) {
+      int from = k == 0 ? origin : stops[k - 1];
+      graph.dijkstraShortestPath(from);
+      vector<Vertex<int> *> leg = graph.getPathV(from, stops[k]);
+      for (unsigned int i = 1; i < leg.size(); i++)
+        expected.push_back(leg[i]->getInfo());
+    }
+    if (v[b]->getPath().empty())
+      expected.push_back(origin);
+    if (expanded[b] != expected)
+      differences++;
+  }
+  return differences;
+}
+
+/*
+ * Solves half of the requests of a grid, then adds the rest online. Counts
+ * the requests a dispatch could not serve, those served out of order, and
+ * the expanded routes that differ from getPathV, after the run and after the
+ * dispatches. The weights have fractions, so shortest paths are unique.
+ */
+int onlineTests(unsigned int numRequests, unsigned int numVehicles) {
+  const int side = 10, origin = (side / 2) * side + side / 2;
+  mt19937 random(4);
+  Graph<int> graph = gridGraph(side, random, true);
+
+  DeliverySystem<int> ds(graph, origin);
+  for (unsigned int b = 0; b < numVehicles; b++)
+    ds.addVehicle("online");
+  vector<Request<int>> requests;
+  for (unsigned int r = 0; r < numRequests; r++) {
+    int pickup = random() % (side * side);
+    int delivery = (pickup + 1 + random() % (side * side - 1)) % (side * side);
+    requests.push_back(Request<int>(pickup, delivery, "online"));
+  }
+  ds.setNumThreads(1);
+  ds.setOnline(true, 20);
+  ds.addRequests(vector<Request<int>>(requests.begin(),
+                                      requests.begin() + numRequests / 2));
+  ds.runEspecialidades();
+  int mismatches = pathDifferences(ds, graph, origin);
+
+  ds.addRequests(vector<Request<int>>(requests.begin() + numRequests / 2,
+                                      requests.end()));
+  for (const DispatchReport &report : ds.getDispatchReports())
+    if (!report.served)
+      mismatches++;
+  if (ds.getDispatchReports().size() != numRequests - numRequests / 2)
+    mismatches++;
+  mismatches += unservedRequests(ds);
+  mismatches += pathDifferences(ds, graph, origin);
+  return mismatches;
+}
+
 void tests() {
 
+  int mismatches = exactTests(20, 4, 2);
+  cout << "Exact solver against brute force: " << mismatches
+       << " mismatches in 20 instances.\n";
+
+  // Maia twice, so all of its nodes and edges come from two extracts
+  vector<string> cities = {"Porto", "Maia", "Ermesinde", "Gondomar", "Maia"};
+  mismatches = loaderTests(cities);
+  cout << "Multi-city loaders: " << mismatches << " differences.\n";
+
+  mismatches = searchTests(10, 30, 3);
+  cout << "Local search and ruin and recreate: " << mismatches
+       << " mismatches in 10 instances.\n";
+
+  mismatches = constraintTests(10, 30, 3);
+  cout << "Windows and capacities: " << mismatches
+       << " mismatches in 10 instances.\n";
+
+  mismatches = onlineTests(40, 3);
+  cout << "Online dispatch and expanded routes: " << mismatches
+       << " mismatches.\n";
+
   Graph<int> graph = test();
 
   DeliverySystem<int> ds(graph, 0);
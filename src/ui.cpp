@@ -42,13 +42,26 @@ void print_main_menu() {
   cout << "Input: ";
 }
 
-int get_node_info() {
+/*
+ * Reads a node ID, or -1 and then X and Y coordinates, which are snapped to
+ * the closest vertex of the map (-1 if the map has none).
+ */
+int get_node_info(const SpatialIndex<int> &spatial) {
   int id;
-  cout << "Insert the node's ID: ";
+  cout << "Insert the node's ID (-1 to give its coordinates): ";
   cin >> id;
+  if (id == -1) {
+    double x, y;
+    cout << "Insert its X and Y coordinates: ";
+    cin >> x >> y;
+    Vertex<int> *v = spatial.nearest(x, y);
+    if (v != nullptr) {
+      id = v->getInfo();
+      cout << "Closest node: " << id << endl;
+    }
+  }
   cin.clear();
   cin.ignore(999999, '\n');
-  cout << "Node successfully added" << endl;
   return id;
 }
 
@@ -63,13 +76,13 @@ void get_vehicle_info(Vehicle<int> &vehicle) {
   cout << "Vehicle successfully created" << endl;
 }
 
-Request<int> get_request() {
+Request<int> get_request(const SpatialIndex<int> &spatial) {
   int origin_id, destination_id;
   string specialty;
   cout << "-> Origin node" << endl;
-  origin_id = get_node_info();
+  origin_id = get_node_info(spatial);
   cout << "-> Destination node" << endl;
-  destination_id = get_node_info();
+  destination_id = get_node_info(spatial);
   cout << "What is the specialty? ";
   getline(cin, specialty);
   Request<int> request(origin_id, destination_id, specialty);
@@ -13,9 +13,9 @@
 #define MAX_OPTION 5
 
 string get_city();
-Request<int> get_request();
+Request<int> get_request(const SpatialIndex<int> &spatial);
 void get_vehicle_info(Vehicle<int> &vehicle);
-int get_node_info();
+int get_node_info(const SpatialIndex<int> &spatial);
 void print_main_menu();
 int get_option();
 bool check_valid_option(int option);
@@ -1,73 +1,310 @@
 
 #include "utils.h"
 
-Graph<int> readFromFile(string city) {
+/*
+ * Parses the nodes and edges of one T08/<city> directory into a CityExtract.
+ * Touches no shared state, so several cities can be parsed at once.
+ */
+bool readCityExtract(string city, CityExtract &extract) {
 
   string line;
   ifstream myFile("./T08/" + city + "/T08_nodes_X_Y_" + city + ".txt");
 
-  Graph<int> myGraph;
-
-  double px = 0, py = 0;
+  extract = CityExtract();
+  extract.city = city;
+  unordered_map<int, unsigned int> position;
 
   if (myFile.is_open()) {
     getline(myFile, line);
     int num_nodes = stoi(line);
-    for (int i = 0; i < num_nodes; i++) {
-      getline(myFile, line);
-      line.erase(0, 1);
-      int id;
-      double x;
-      double y;
-      size_t pos = 0;
-      pos = line.find(",");
-      id = stoi(line.substr(0, pos));
-      line.erase(0, pos + 1);
-      pos = line.find(",");
-      x = stod(line.substr(0, pos));
-      line.erase(0, pos + 1);
-      pos = line.find(",");
-      y = stod(line.substr(0, pos));
-      if (px == 0 && py == 0) {
-        px = x;
-        py = y;
+    extract.ids.reserve(num_nodes);
+    extract.x.reserve(num_nodes);
+    extract.y.reserve(num_nodes);
+    position.reserve(num_nodes);
+    for (int i = 0; i < num_nodes && getline(myFile, line); i++) {
+      char *end;
+      int id = strtol(line.c_str() + 1, &end, 10);
+      double x = strtod(end + 1, &end);
+      double y = strtod(end + 1, &end);
+      if (i == 0) {
+        extract.originX = x;
+        extract.originY = y;
       }
-      myGraph.addVertex(id, x - px, y - py);
+      if (!position.insert(make_pair(id, extract.ids.size())).second)
+        continue;
+      extract.ids.push_back(id);
+      extract.x.push_back((int)((x - extract.originX) * 100));
+      extract.y.push_back((int)((y - extract.originY) * 100));
     }
     myFile.close();
   } else {
     cout << "Could not open file " << city << endl;
-    //exit(1);
+    return false;
   }
   ifstream myFileEdge("./T08/" + city + "/T08_edges_" + city + ".txt");
 
   if (myFileEdge.is_open()) {
     getline(myFileEdge, line);
     int num_edges = stoi(line);
-    for (int i = 0; i < num_edges; i++) {
-      getline(myFileEdge, line);
-      line.erase(0, 1);
-      int id1;
-      int id2;
-      size_t pos = 0;
-      pos = line.find(",");
-      id1 = stoi(line.substr(0, pos));
-      line.erase(0, pos + 1);
-      pos = line.find(",");
-      id2 = stod(line.substr(0, pos));
-      myGraph.addEdge(id1, id2);
+    extract.edges.reserve(num_edges);
+    for (int i = 0; i < num_edges && getline(myFileEdge, line); i++) {
+      char *end;
+      int id1 = strtol(line.c_str() + 1, &end, 10);
+      int id2 = strtol(end + 1, &end, 10);
+      auto it1 = position.find(id1);
+      auto it2 = position.find(id2);
+      if (it1 != position.end() && it2 != position.end())
+        extract.edges.push_back(make_pair(it1->second, it2->second));
     }
     myFileEdge.close();
   } else {
     cout << "Could not open file " << city << endl;
-    //exit(1);
+    extract = CityExtract(); // no nodes without their edges
+    extract.city = city;
+    return false;
   }
+  return true;
+}
+
+Graph<int> readFromFile(string city) {
+
+  CityExtract extract;
+  Graph<int> myGraph;
+  if (!readCityExtract(city, extract))
+    return myGraph;
+
+  myGraph.reserve(extract.ids.size());
+
+  for (size_t i = 0; i < extract.ids.size(); i++)
+    myGraph.addVertex(extract.ids[i], extract.x[i] / 100.0,
+                      extract.y[i] / 100.0);
+  for (size_t i = 0; i < extract.edges.size(); i++)
+    myGraph.addEdge(extract.ids[extract.edges[i].first],
+                    extract.ids[extract.edges[i].second]);
 
   cout << "Map loaded successfully." << endl;
 
   return myGraph;
 }
 
+/*
+ * Parses several cities in parallel, at most one thread per core. Returns
+ * false if some city could not be read; its extract is left empty and the
+ * others are still parsed.
+ */
+bool readCityExtracts(vector<string> cities, vector<CityExtract> &extracts) {
+  extracts.assign(cities.size(), CityExtract());
+  vector<char> loaded(cities.size(), false);
+  vector<thread> workers;
+  size_t batch = max(thread::hardware_concurrency(), 1u);
+  for (size_t first = 0; first < cities.size(); first += batch) {
+    for (size_t i = first; i < cities.size() && i < first + batch; i++)
+      workers.push_back(thread([&cities, &extracts, &loaded, i]() {
+        loaded[i] = readCityExtract(cities[i], extracts[i]);
+      }));
+    for (size_t i = 0; i < workers.size(); i++)
+      workers[i].join();
+    workers.clear();
+  }
+  return find(loaded.begin(), loaded.end(), false) == loaded.end();
+}
+
+/*
+ * Loads several T08/<city> directories into a single graph. The files of each
+ * city are parsed in parallel; the extracts are then merged in the given
+ * order, so the result does not depend on thread timing. Nodes shared by
+ * several extracts (same OSM id) are added once and belong to the first city
+ * that lists them: partition[i] is the position in cities of the city of the
+ * vertex with index i. All coordinates are relative to the first node of the
+ * first city. The graph is built into the given (empty) myGraph; returns false,
+ * with the cities that could be read still merged, if some city is missing.
+ */
+bool readFromFiles(vector<string> cities, Graph<int> &myGraph,
+                   vector<unsigned short> &partition) {
+
+  vector<CityExtract> extracts;
+  bool loaded = readCityExtracts(cities, extracts);
+
+  size_t num_nodes = 0;
+  for (size_t c = 0; c < extracts.size(); c++)
+    num_nodes += extracts[c].ids.size();
+
+  myGraph.reserve(num_nodes);
+  partition.clear();
+  partition.reserve(num_nodes);
+
+  double px = 0, py = 0;
+  bool origin = false;
+  for (size_t c = 0; c < extracts.size(); c++) {
+    CityExtract &e = extracts[c];
+    if (!origin && !e.ids.empty()) {
+      px = e.originX;
+      py = e.originY;
+      origin = true;
+    }
+    // offsets in whole centimetres, as in readFromFilesCompact
+    int dx = (int)((e.originX - px) * 100);
+    int dy = (int)((e.originY - py) * 100);
+    for (size_t i = 0; i < e.ids.size(); i++)
+      if (myGraph.addVertex(e.ids[i], (dx + e.x[i]) / 100.0,
+                            (dy + e.y[i]) / 100.0))
+        partition.push_back(c);
+  }
+  for (size_t c = 0; c < extracts.size(); c++) {
+    CityExtract &e = extracts[c];
+    for (size_t i = 0; i < e.edges.size(); i++)
+      myGraph.addEdge(e.ids[e.edges[i].first], e.ids[e.edges[i].second]);
+    e = CityExtract(); // release the extract as soon as it is merged
+  }
+
+  if (loaded)
+    cout << "Map loaded successfully (" << myGraph.getNumVertex()
+         << " nodes from " << cities.size() << " cities)." << endl;
+
+  return loaded;
+}
+
+/*
+ * Same as readFromFiles, but builds a CompactGraph straight from the packed
+ * extracts, so the pointer-based graph is never allocated. Edges listed by
+ * more than one extract are kept once, as Graph::addEdge does.
+ */
+bool readFromFilesCompact(vector<string> cities, CompactGraph<int> &graph,
+                          vector<unsigned short> &partition) {
+
+  vector<CityExtract> extracts;
+  bool loaded = readCityExtracts(cities, extracts);
+
+  size_t num_nodes = 0, num_edges = 0;
+  for (size_t c = 0; c < extracts.size(); c++) {
+    num_nodes += extracts[c].ids.size();
+    num_edges += extracts[c].edges.size();
+  }
+
+  vector<int> ids;
+  vector<int32_t> x, y;
+  vector<pair<uint32_t, uint32_t>> edges;
+  unordered_map<int, uint32_t> position;
+  ids.reserve(num_nodes);
+  x.reserve(num_nodes);
+  y.reserve(num_nodes);
+  edges.reserve(num_edges);
+  position.reserve(num_nodes);
+  partition.clear();
+  partition.reserve(num_nodes);
+
+  double px = 0, py = 0;
+  bool origin = false;
+  for (size_t c = 0; c < extracts.size(); c++) {
+    CityExtract &e = extracts[c];
+    if (!origin && !e.ids.empty()) {
+      px = e.originX;
+      py = e.originY;
+      origin = true;
+    }
+    int32_t dx = (int32_t)((e.originX - px) * 100);
+    int32_t dy = (int32_t)((e.originY - py) * 100);
+    vector<uint32_t> local(e.ids.size());
+    for (size_t i = 0; i < e.ids.size(); i++) {
+      auto res = position.insert(make_pair(e.ids[i], (uint32_t)ids.size()));
+      local[i] = res.first->second;
+      if (!res.second)
+        continue;
+      ids.push_back(e.ids[i]);
+      x.push_back(dx + e.x[i]);
+      y.push_back(dy + e.y[i]);
+      partition.push_back(c);
+    }
+    for (size_t i = 0; i < e.edges.size(); i++)
+      edges.push_back(make_pair(local[e.edges[i].first],
+                                local[e.edges[i].second]));
+    e = CityExtract();
+  }
+  position.clear();
+  sort(edges.begin(), edges.end());
+  edges.erase(unique(edges.begin(), edges.end()), edges.end());
+
+  if (loaded)
+    cout << "Map loaded successfully (" << ids.size() << " nodes from "
+         << cities.size() << " cities)." << endl;
+
+  graph = CompactGraph<int>(ids, x, y, edges);
+  return loaded;
+}
+
+/*
+ * Reads T08_tags_<city>.txt one line at a time and keeps, for every tag, only
+ * the nodes that exist in the given map. Works for the national
+ * T08_tags_Portugal.txt as well, without holding the file in memory.
+ */
+TagIndex<int> readTagsFromFile(string city, const Graph<int> &graph) {
+
+  string line;
+  ifstream myFile("./T08/" + city + "/T08_tags_" + city + ".txt");
+
+  TagIndex<int> tags;
+  tags.setGraph(graph);
+
+  if (myFile.is_open()) {
+    getline(myFile, line);
+    int num_tags = stoi(line);
+    for (int i = 0; i < num_tags && getline(myFile, line); i++) {
+      string tag = line;
+      getline(myFile, line);
+      int num_nodes = stoi(line);
+      vector<unsigned int> vertices;
+      for (int a = 0; a < num_nodes && getline(myFile, line); a++) {
+        int idx = graph.findVertexIdx(stoi(line));
+        if (idx != -1)
+          vertices.push_back(idx);
+      }
+      tags.addTag(tag, vertices);
+    }
+    myFile.close();
+  } else {
+    cout << "Could not open file " << city << endl;
+  }
+
+  return tags;
+}
+
+/*
+ * Reads T08_nodes_lat_lon_<city>.txt into arrays indexed by the dense vertex
+ * index of the given map (see SpatialIndex::build). Nodes missing from the
+ * file are left at NaN.
+ */
+bool readLatLonFromFile(string city, const Graph<int> &graph,
+                        vector<double> &lat, vector<double> &lon) {
+
+  string line;
+  ifstream myFile("./T08/" + city + "/T08_nodes_lat_lon_" + city + ".txt");
+
+  lat.assign(graph.getNumVertex(), numeric_limits<double>::quiet_NaN());
+  lon.assign(graph.getNumVertex(), numeric_limits<double>::quiet_NaN());
+
+  if (!myFile.is_open()) {
+    cout << "Could not open file " << city << endl;
+    return false;
+  }
+
+  getline(myFile, line);
+  int num_nodes = stoi(line);
+  for (int i = 0; i < num_nodes && getline(myFile, line); i++) {
+    line.erase(0, 1);
+    size_t pos = line.find(",");
+    int idx = graph.findVertexIdx(stoi(line.substr(0, pos)));
+    if (idx == -1)
+      continue;
+    line.erase(0, pos + 1);
+    pos = line.find(",");
+    lat[idx] = stod(line.substr(0, pos));
+    line.erase(0, pos + 1);
+    lon[idx] = stod(line);
+  }
+  myFile.close();
+  return true;
+}
+
 Graph<int> createGraph1() {
   Graph<int> myGraph;
 
@@ -7,14 +7,47 @@
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <thread>
 
 #include "DeliverySystem.h"
+#include "SolverHandle.h"
+#include "TagIndex.h"
+#include "SpatialIndex.h"
+#include "CompactGraph.h"
 
 #define VERTEXNORMALCOLOR "BLUE"
 #define VERTEXPATHCOLOR "RED"
 
+/*
+ * Nodes and edges of one T08/<city> directory as read from the files.
+ * Coordinates are packed as 32-bit centimetres relative to the first node
+ * (originX, originY) and edges as pairs of positions in the node arrays.
+ */
+struct CityExtract {
+  string city;
+  double originX = 0, originY = 0;
+  vector<int> ids;
+  vector<int> x, y;
+  vector<pair<unsigned int, unsigned int>> edges;
+};
+
+bool readCityExtract(string city, CityExtract &extract);
+
+bool readCityExtracts(vector<string> cities, vector<CityExtract> &extracts);
+
 Graph<int> readFromFile(string city);
 
+bool readFromFiles(vector<string> cities, Graph<int> &graph,
+                   vector<unsigned short> &partition);
+
+bool readFromFilesCompact(vector<string> cities, CompactGraph<int> &graph,
+                          vector<unsigned short> &partition);
+
+TagIndex<int> readTagsFromFile(string city, const Graph<int> &graph);
+
+bool readLatLonFromFile(string city, const Graph<int> &graph,
+                        vector<double> &lat, vector<double> &lon);
+
 Graph<int> createGraph6();
 
 Graph<int> createGraph5();